@@ -0,0 +1,115 @@
+// File: alu_bench.cpp
+//
+// Created by Adrian Habusta on 17.10.2026
+//
+
+// Measures how fast the CPU runs an ALU heavy instruction mix. The ROM is generated here, it turns the LCD off so that
+// the PPU doesn't draw, and then loops over the mix forever.
+
+#include <string_view>
+#include <filesystem>
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "emulator.hpp"
+
+constexpr std::size_t default_frame_count = 3000;
+constexpr std::size_t rom_size = 0x8000;
+constexpr word entry_point = 0x100;
+constexpr word program_start = 0x150;
+
+#if defined(CPU_LAZY_FLAGS)
+constexpr std::string_view flags_mode = "lazy flags";
+#else
+constexpr std::string_view flags_mode = "eager flags";
+#endif
+
+std::vector<byte> create_rom() {
+    std::vector<byte> rom(rom_size, 0x00);
+
+    // NOP, JP program_start
+    const byte entry[] = { 0x00, 0xC3, utility::get_low_byte(program_start), utility::get_high_byte(program_start) };
+    std::copy(std::begin(entry), std::end(entry), rom.begin() + entry_point);
+
+    const byte program[] = {
+        0xF3,                   // DI
+        0xAF, 0xE0, 0x40,       // XOR A / LDH (LCDC),A
+        0x01, 0x34, 0x12,       // LD BC,0x1234
+        0x11, 0x78, 0x56,       // LD DE,0x5678
+        0x21, 0xBC, 0x9A,       // LD HL,0x9ABC
+
+        // The loop starts here
+        0x80, 0x89, 0x92, 0x9B, // ADD A,B / ADC A,C / SUB D / SBC A,E
+        0xA4, 0xB5,             // AND H / OR L
+        0xEE, 0x5A, 0xFE, 0x33, // XOR 0x5A / CP 0x33
+        0x04, 0x0D, 0x14, 0x1D, // INC B / DEC C / INC D / DEC E
+        0x07, 0x1F,             // RLCA / RRA
+        0xCB, 0x14, 0xCB, 0x3D, // RL H / SRL L
+        0xCB, 0x37, 0xCB, 0x58, // SWAP A / BIT 3,B
+        0xC6, 0x17, 0xD6, 0x29, // ADD A,0x17 / SUB 0x29
+        0x8D, 0x9C,             // ADC A,L / SBC A,H
+        0x28, 0x00,             // JR Z,+0, only reads Z
+        0x3C, 0x27,             // INC A / DAA, which reads all flags
+        0x38, 0x00,             // JR C,+0
+        0xC3, 0x00, 0x00,       // JP loop
+    };
+    constexpr std::size_t loop_offset = 13;
+
+    std::copy(std::begin(program), std::end(program), rom.begin() + program_start);
+
+    word loop_address = program_start + loop_offset;
+    std::size_t jump_operand = program_start + sizeof(program) - 2;
+    rom[jump_operand] = utility::get_low_byte(loop_address);
+    rom[jump_operand + 1] = utility::get_high_byte(loop_address);
+
+    return rom;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cout << "Usage: alu_bench boot_rom [frames]" << std::endl;
+        return 1;
+    }
+
+    std::string_view boot_rom_path = argv[1];
+    std::size_t frame_count = argc > 2 ? std::stoul(argv[2]) : default_frame_count;
+
+    auto rom_path = std::filesystem::temp_directory_path() / "alu_bench.gb";
+    {
+        auto rom = create_rom();
+        std::ofstream file(rom_path, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(rom.data()), static_cast<std::streamsize>(rom.size()));
+    }
+
+    // Nothing is shown
+    frontend::null_frame_sink frames;
+    frontend::null_input_source input;
+
+    int result = 0;
+    try {
+        emulator::emulator emu(frames, input, boot_rom_path, rom_path.string(), "");
+        emu.set_frame_rate_limited(false);
+
+        auto start = std::chrono::steady_clock::now();
+        while (emu.get_frame_count() < frame_count) {
+            if (emu.run_frame() == emulator::run_result::quit_requested)
+                break;
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        double seconds = elapsed.count();
+        std::cout << "ALU mix (" << flags_mode << "): " << frame_count << " frames in " << seconds << " s, "
+                  << emu.get_total_machine_cycles() / seconds / 1e6 << " MHz (M-cycles)" << std::endl;
+    }
+    catch (const std::runtime_error& e) {
+        std::cout << e.what() << std::endl;
+        result = 1;
+    }
+
+    std::filesystem::remove(rom_path);
+
+    return result;
+}
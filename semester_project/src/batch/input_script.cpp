@@ -0,0 +1,76 @@
+// File: input_script.cpp
+//
+// Created by Adrian Habusta on 17.10.2026
+//
+
+#include <algorithm>
+#include <stdexcept>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "input_script.hpp"
+
+namespace batch {
+    namespace {
+        std::optional<frontend::button> parse_button(std::string_view name) {
+            if (name == "right") return frontend::button::right;
+            if (name == "left") return frontend::button::left;
+            if (name == "up") return frontend::button::up;
+            if (name == "down") return frontend::button::down;
+            if (name == "a") return frontend::button::a;
+            if (name == "b") return frontend::button::b;
+            if (name == "select") return frontend::button::select;
+            if (name == "start") return frontend::button::start;
+
+            return std::nullopt;
+        }
+    }
+
+    input_script::input_script(std::string_view path) {
+        std::ifstream file{std::string(path)};
+        if (!file.is_open())
+            throw std::runtime_error("Failed to open input script " + std::string(path));
+
+        std::string line;
+        for (std::size_t line_number = 1; std::getline(file, line); ++line_number) {
+            if (line.empty() || line[0] == '#')
+                continue;
+
+            std::istringstream fields(line);
+            std::size_t frame;
+            std::string action, button_name;
+            fields >> frame >> action >> button_name;
+
+            auto changed_button = parse_button(button_name);
+            if (fields.fail() || !changed_button || (action != "press" && action != "release")) {
+                throw std::runtime_error("Invalid input script line " + std::to_string(line_number) + " in " +
+                                         std::string(path));
+            }
+
+            auto type = action == "press" ? frontend::input_event::type::button_pressed
+                                          : frontend::input_event::type::button_released;
+            events.push_back({frame, {type, *changed_button}});
+        }
+
+        // Events of the same frame keep their order
+        std::stable_sort(events.begin(), events.end(), [](const timed_event& left, const timed_event& right) {
+            return left.frame < right.frame;
+        });
+    }
+
+    bool input_script::skip_to_next_event() {
+        if (next_event == events.size())
+            return false;
+
+        current_frame = std::max(current_frame, events[next_event].frame);
+        return true;
+    }
+
+    std::optional<frontend::input_event> input_script::poll_event() {
+        if (next_event == events.size() || events[next_event].frame > current_frame)
+            return std::nullopt;
+
+        return events[next_event++].event;
+    }
+}
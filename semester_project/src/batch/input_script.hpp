@@ -0,0 +1,43 @@
+// File: input_script.hpp
+//
+// Created by Adrian Habusta on 17.10.2026
+//
+
+#ifndef SEMESTER_PROJECT_INPUT_SCRIPT_HPP
+#define SEMESTER_PROJECT_INPUT_SCRIPT_HPP
+
+#include <string_view>
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "../frontend/input_source.hpp"
+
+namespace batch {
+    // Replays button presses at fixed frames. Every line of the file is "<frame> press|release <button>", where the
+    // buttons are named like frontend::button, empty lines and lines starting with # are skipped.
+    class input_script : public frontend::input_source {
+        struct timed_event {
+            std::size_t frame;
+            frontend::input_event event;
+        };
+
+        std::vector<timed_event> events;
+        std::size_t next_event{};
+        std::size_t current_frame{};
+
+    public:
+        input_script() = default;
+        explicit input_script(std::string_view path);
+
+        // Events up to and including this frame are delivered on the next poll. The frame never goes back, so a frame
+        // skipped to while the CPU was stopped isn't lost when the frame count of the emulator is set again.
+        void set_frame(std::size_t frame) { current_frame = std::max(current_frame, frame); }
+        // Used while the CPU is stopped and frames don't advance, returns false if no events are left
+        bool skip_to_next_event();
+
+        std::optional<frontend::input_event> poll_event() override;
+    };
+}
+
+#endif //SEMESTER_PROJECT_INPUT_SCRIPT_HPP
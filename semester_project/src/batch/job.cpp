@@ -0,0 +1,175 @@
+// File: job.cpp
+//
+// Created by Adrian Habusta on 17.10.2026
+//
+
+#include <filesystem>
+#include <stdexcept>
+#include <optional>
+#include <charconv>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <vector>
+
+#include "../emulator.hpp"
+#include "input_script.hpp"
+#include "job.hpp"
+
+namespace batch {
+    namespace {
+        // FNV-1a
+        constexpr std::uint64_t hash_offset_basis = 0xCBF29CE484222325;
+        constexpr std::uint64_t hash_prime = 0x100000001B3;
+
+        std::uint64_t hash_bytes(const void* data, std::size_t size, std::uint64_t hash = hash_offset_basis) {
+            const auto* bytes = static_cast<const unsigned char*>(data);
+            for (std::size_t i = 0; i < size; ++i) {
+                hash ^= bytes[i];
+                hash *= hash_prime;
+            }
+
+            return hash;
+        }
+
+        std::string resolve_path(const std::filesystem::path& directory, std::string_view path) {
+            if (path.empty() || std::filesystem::path(path).is_absolute())
+                return std::string(path);
+
+            return (directory / path).string();
+        }
+
+        void write_frame(const std::string& path, const frontend::frame_buffer& frame) {
+            std::ofstream file(path, std::ios::binary);
+            if (!file.is_open())
+                throw std::runtime_error("Failed to write frame " + path);
+
+            file << "P6 " << pixel_processing_unit::screen_pixel_width << ' '
+                 << pixel_processing_unit::screen_pixel_height << " 255\n";
+
+            for (const auto& row : frame) {
+                for (auto pixel : row) {
+                    // ARGB
+                    char rgb[] = {static_cast<char>(pixel >> 16), static_cast<char>(pixel >> 8),
+                                  static_cast<char>(pixel)};
+                    file.write(rgb, sizeof(rgb));
+                }
+            }
+        }
+    }
+
+    std::vector<job> read_manifest(std::string_view path) {
+        std::ifstream file{std::string(path)};
+        if (!file.is_open())
+            throw std::runtime_error("Failed to open manifest " + std::string(path));
+
+        auto directory = std::filesystem::path(path).parent_path();
+
+        std::vector<job> jobs;
+        std::string line;
+        for (std::size_t line_number = 1; std::getline(file, line); ++line_number) {
+            if (line.empty() || line[0] == '#')
+                continue;
+
+            auto fail = [&](const std::string& reason) {
+                throw std::runtime_error(reason + " on manifest line " + std::to_string(line_number));
+            };
+
+            job parsed_job;
+            std::optional<std::size_t> frame_count;
+
+            std::istringstream fields(line);
+            std::string field;
+            while (fields >> field) {
+                auto separator = field.find('=');
+                if (separator == std::string::npos)
+                    fail("Expected key=value, got " + field);
+
+                std::string key = field.substr(0, separator);
+                std::string value = field.substr(separator + 1);
+
+                if (key == "name") parsed_job.name = value;
+                else if (key == "boot_rom") parsed_job.boot_rom_path = resolve_path(directory, value);
+                else if (key == "rom") parsed_job.rom_path = resolve_path(directory, value);
+                else if (key == "input") parsed_job.input_path = resolve_path(directory, value);
+                else if (key == "frame_output") parsed_job.frame_output_path = resolve_path(directory, value);
+                else if (key == "frames") {
+                    // The whole value has to be a number, without a sign
+                    std::size_t count{};
+                    auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), count);
+                    if (error != std::errc() || end != value.data() + value.size())
+                        fail("Invalid frame count " + value);
+
+                    frame_count = count;
+                }
+                else fail("Unknown key " + key);
+            }
+
+            if (parsed_job.boot_rom_path.empty() || parsed_job.rom_path.empty() || !frame_count)
+                fail("boot_rom, rom and frames are required");
+
+            parsed_job.frame_count = *frame_count;
+            if (parsed_job.name.empty())
+                parsed_job.name = std::filesystem::path(parsed_job.rom_path).stem().string();
+
+            jobs.push_back(std::move(parsed_job));
+        }
+
+        return jobs;
+    }
+
+    job_result run_job(const job& job_to_run) {
+        job_result result;
+        auto start = std::chrono::steady_clock::now();
+
+        try {
+            frontend::memory_frame_sink frames;
+            input_script input = job_to_run.input_path.empty() ? input_script() : input_script(job_to_run.input_path);
+
+            std::optional<emulator::emulator> emu;
+            emu.emplace(frames, input, job_to_run.boot_rom_path, job_to_run.rom_path, "");
+            emu->set_frame_rate_limited(false);
+
+            while (emu->get_frame_count() < job_to_run.frame_count) {
+                input.set_frame(emu->get_frame_count());
+                auto run_result = emu->run_frame();
+
+                // Frames don't advance while the CPU is stopped, only a button press can wake it up
+                if (run_result == emulator::run_result::stop && !input.skip_to_next_event()) {
+                    result.stopped_early = true;
+                    break;
+                }
+            }
+
+            const auto& frame = frames.get_frame();
+            result.frames = emu->get_frame_count();
+            result.machine_cycles = emu->get_total_machine_cycles();
+            result.tile_cache_hits = emu->get_tile_cache_statistics().hits;
+            result.tile_cache_misses = emu->get_tile_cache_statistics().misses;
+
+            const auto& idle_loops = emu->get_cpu().get_idle_loops();
+            result.analyzed_loops = idle_loops.analyzed_loops;
+            result.idle_loops = idle_loops.idle_loops;
+            result.fast_forwards = idle_loops.fast_forwards;
+            result.fast_forwarded_machine_cycles = idle_loops.fast_forwarded_machine_cycles;
+
+            result.frame_hash = hash_bytes(frame, sizeof(frame));
+
+            // The save state holds everything that decides what the machine does next
+            std::vector<byte> state(emu->get_state_size());
+            std::size_t state_size = emu->save_state(state);
+            result.state_hash = hash_bytes(state.data(), state_size, result.frame_hash);
+
+            if (!job_to_run.frame_output_path.empty())
+                write_frame(job_to_run.frame_output_path, frame);
+
+            result.succeeded = true;
+        }
+        catch (const std::exception& e) {
+            result.error = e.what();
+        }
+
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return result;
+    }
+}
@@ -0,0 +1,58 @@
+// File: job.hpp
+//
+// Created by Adrian Habusta on 17.10.2026
+//
+
+#ifndef SEMESTER_PROJECT_JOB_HPP
+#define SEMESTER_PROJECT_JOB_HPP
+
+#include <string_view>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace batch {
+    struct job {
+        std::string name;
+        std::string boot_rom_path;
+        std::string rom_path;
+        // Both optional, empty if not given
+        std::string input_path;
+        std::string frame_output_path;
+        std::size_t frame_count{};
+    };
+
+    struct job_result {
+        bool succeeded{false};
+        // Why the job failed, or empty
+        std::string error;
+
+        std::size_t frames{};
+        std::size_t machine_cycles{};
+        // The CPU stopped and the input script had no more events to wake it up
+        bool stopped_early{false};
+
+        // Of the last frame, and of the last frame together with the whole save state of the machine
+        std::uint64_t frame_hash{};
+        std::uint64_t state_hash{};
+        // Tile rows the PPU took from its cache of decoded tiles, and tiles it had to decode again
+        std::size_t tile_cache_hits{};
+        std::size_t tile_cache_misses{};
+        // Loops the CPU checked for being idle, how many were, and how often and how far it skipped ahead through them
+        std::uint64_t analyzed_loops{};
+        std::uint64_t idle_loops{};
+        std::uint64_t fast_forwards{};
+        std::uint64_t fast_forwarded_machine_cycles{};
+        double seconds{};
+    };
+
+    // Every line describes one job as whitespace separated key=value pairs: name, boot_rom, rom, frames, and
+    // optionally input (see input_script) and frame_output (a PPM file of the last frame). Relative paths are relative
+    // to the manifest. Empty lines and lines starting with # are skipped.
+    std::vector<job> read_manifest(std::string_view path);
+
+    // Runs the job on its own emulator, doesn't throw
+    job_result run_job(const job& job_to_run);
+}
+
+#endif //SEMESTER_PROJECT_JOB_HPP
@@ -0,0 +1,86 @@
+// File: work_stealing_pool.cpp
+//
+// Created by Adrian Habusta on 17.10.2026
+//
+
+#include <algorithm>
+#include <optional>
+#include <vector>
+#include <thread>
+#include <deque>
+#include <mutex>
+
+#include "work_stealing_pool.hpp"
+
+namespace batch {
+    namespace {
+        struct task_queue {
+            std::mutex lock;
+            std::deque<std::size_t> tasks;
+
+            std::optional<std::size_t> pop_front() {
+                std::scoped_lock guard(lock);
+                if (tasks.empty())
+                    return std::nullopt;
+
+                std::size_t task = tasks.front();
+                tasks.pop_front();
+                return task;
+            }
+
+            std::optional<std::size_t> steal_back() {
+                std::scoped_lock guard(lock);
+                if (tasks.empty())
+                    return std::nullopt;
+
+                std::size_t task = tasks.back();
+                tasks.pop_back();
+                return task;
+            }
+        };
+
+        std::optional<std::size_t> steal(std::vector<task_queue>& queues, std::size_t thief) {
+            for (std::size_t offset = 1; offset < queues.size(); ++offset) {
+                if (auto task = queues[(thief + offset) % queues.size()].steal_back())
+                    return task;
+            }
+
+            return std::nullopt;
+        }
+    }
+
+    std::size_t work_stealing_pool::run(std::size_t task_count, const std::function<void(std::size_t)>& task) const {
+        std::size_t worker_count = std::min(thread_count, task_count);
+        if (worker_count == 0)
+            return 0;
+
+        // Neighbouring tasks go to the same thread, they are often similar in length
+        std::vector<task_queue> queues(worker_count);
+        for (std::size_t i = 0; i < task_count; ++i)
+            queues[i * worker_count / task_count].tasks.push_back(i);
+
+        auto work = [&](std::size_t worker) {
+            while (true) {
+                auto next = queues[worker].pop_front();
+                if (!next)
+                    next = steal(queues, worker);
+                // No tasks are added once the threads start, so if nothing can be stolen, everything is taken
+                if (!next)
+                    return;
+
+                task(*next);
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (std::size_t worker = 1; worker < worker_count; ++worker)
+            threads.emplace_back(work, worker);
+
+        work(0);
+
+        for (auto& thread : threads)
+            thread.join();
+
+        return worker_count;
+    }
+}
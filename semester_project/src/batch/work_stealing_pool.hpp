@@ -0,0 +1,29 @@
+// File: work_stealing_pool.hpp
+//
+// Created by Adrian Habusta on 17.10.2026
+//
+
+#ifndef SEMESTER_PROJECT_WORK_STEALING_POOL_HPP
+#define SEMESTER_PROJECT_WORK_STEALING_POOL_HPP
+
+#include <functional>
+#include <cstddef>
+
+namespace batch {
+    // Runs a fixed number of tasks, given by their index, on a number of threads. Every thread starts with an even
+    // share of the tasks, and when it runs out, it steals the last tasks of the other threads. Tasks must not throw.
+    class work_stealing_pool {
+        std::size_t thread_count;
+
+    public:
+        explicit work_stealing_pool(std::size_t thread_count) : thread_count(thread_count > 0 ? thread_count : 1) {}
+
+        // Blocks until every task has finished, task is called from all threads at once. Never starts more threads than
+        // there are tasks, returns how many it used.
+        std::size_t run(std::size_t task_count, const std::function<void(std::size_t)>& task) const;
+
+        [[nodiscard]] std::size_t get_thread_count() const { return thread_count; }
+    };
+}
+
+#endif //SEMESTER_PROJECT_WORK_STEALING_POOL_HPP
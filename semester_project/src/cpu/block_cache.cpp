@@ -0,0 +1,134 @@
+// File: block_cache.cpp
+//
+// Created by Adrian Habusta on 17.10.2026
+//
+
+#include "block_cache.hpp"
+
+namespace central_processing_unit {
+    namespace {
+        constexpr byte instruction_lengths[256] = {
+            1, 3, 1, 1, 1, 1, 2, 1, 3, 1, 1, 1, 1, 1, 2, 1,
+            1, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+            2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+            2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+            1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+            1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+            1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+            1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+            1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+            1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+            1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+            1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+            1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 2, 3, 3, 2, 1,
+            1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 1, 2, 1,
+            2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1,
+            2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1,
+        };
+
+        // Includes the opcode fetch, excludes the extra cycles of taken branches. CB prefixed instructions are counted
+        // separately.
+        constexpr byte instruction_machine_cycles[256] = {
+            1, 3, 2, 2, 1, 1, 2, 1, 5, 2, 2, 2, 1, 1, 2, 1,
+            1, 3, 2, 2, 1, 1, 2, 1, 3, 2, 2, 2, 1, 1, 2, 1,
+            2, 3, 2, 2, 1, 1, 2, 1, 2, 2, 2, 2, 1, 1, 2, 1,
+            2, 3, 2, 2, 3, 3, 3, 1, 2, 2, 2, 2, 1, 1, 2, 1,
+            1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+            1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+            1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+            2, 2, 2, 2, 2, 2, 1, 2, 1, 1, 1, 1, 1, 1, 2, 1,
+            1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+            1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+            1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+            1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+            2, 3, 3, 4, 3, 4, 2, 4, 2, 4, 3, 2, 3, 6, 2, 4,
+            2, 3, 3, 1, 3, 4, 2, 4, 2, 4, 3, 1, 3, 1, 2, 4,
+            3, 3, 2, 1, 1, 4, 2, 4, 4, 1, 4, 1, 1, 1, 2, 4,
+            3, 3, 2, 1, 1, 4, 2, 4, 3, 2, 4, 1, 1, 1, 2, 4,
+        };
+
+        constexpr byte cb_prefix = 0xCB;
+        constexpr byte cb_indirect_operand = 6;
+        constexpr byte cb_bit_group = 1;
+
+        constexpr byte load_a_indirect_hl_increment = 0x2A;
+        constexpr byte load_a_high_page = 0xF0;
+        constexpr byte compare_immediate = 0xFE;
+        constexpr byte jump_relative_not_zero = 0x20;
+        constexpr byte jump_relative_zero = 0x28;
+
+        constexpr bool is_8bit_decrement(byte opcode) {
+            // DEC B/C/D/E/H/L/A, DEC (HL) is left out since it touches memory
+            return (opcode & 0xC7) == 0x05 && opcode != 0x35;
+        }
+    }
+
+    bool block_cache::ends_block(byte opcode) {
+        switch (opcode) {
+            // jumps
+            case 0x18: case 0x20: case 0x28: case 0x30: case 0x38:
+            case 0xC3: case 0xC2: case 0xCA: case 0xD2: case 0xDA: case 0xE9:
+            // calls and restarts
+            case 0xCD: case 0xC4: case 0xCC: case 0xD4: case 0xDC:
+            case 0xC7: case 0xCF: case 0xD7: case 0xDF: case 0xE7: case 0xEF: case 0xF7: case 0xFF:
+            // returns
+            case 0xC9: case 0xC0: case 0xC8: case 0xD0: case 0xD8: case 0xD9:
+            // CPU state changes
+            case 0x10: case 0x76: case 0xFB:
+            // unknown instructions crash the CPU
+            case 0xD3: case 0xDB: case 0xDD: case 0xE3: case 0xE4: case 0xEB: case 0xEC: case 0xED:
+            case 0xF4: case 0xFC: case 0xFD:
+                return true;
+
+            default:
+                return false;
+        }
+    }
+
+    byte block_cache::get_instruction_length(byte opcode) {
+        return instruction_lengths[opcode];
+    }
+
+    byte block_cache::get_machine_cycles(byte opcode, byte cb_opcode) {
+        if (opcode != cb_prefix)
+            return instruction_machine_cycles[opcode];
+
+        if ((cb_opcode & 0x07) != cb_indirect_operand)
+            return 2;
+
+        // BIT only reads (HL), everything else writes the result back
+        return (cb_opcode >> 6) == cb_bit_group ? 3 : 4;
+    }
+
+    word block_cache::get_region_end(word address, int bank) {
+        if (bank == boot_rom_bank)
+            return boot_rom_end_address;
+
+        if (address < switchable_bank_start_address)
+            return switchable_bank_start_address - 1;
+
+        return rom_end_address;
+    }
+
+    void block_cache::mark_fused_sequences(basic_block& block) {
+        auto& instructions = block.instructions;
+
+        for (std::size_t i = 0; i + 1 < instructions.size(); ++i) {
+            byte first = instructions[i].opcode;
+            byte second = instructions[i + 1].opcode;
+            byte third = i + 2 < instructions.size() ? instructions[i + 2].opcode : 0x00;
+
+            if (first == load_a_indirect_hl_increment && second == compare_immediate &&
+                third == jump_relative_not_zero) {
+                instructions[i].fused = fused_sequence::load_increment_compare_branch;
+            }
+            else if (first == load_a_high_page && second == compare_immediate &&
+                     (third == jump_relative_not_zero || third == jump_relative_zero)) {
+                instructions[i].fused = fused_sequence::load_high_compare_branch;
+            }
+            else if (is_8bit_decrement(first) && second == jump_relative_not_zero) {
+                instructions[i].fused = fused_sequence::decrement_branch;
+            }
+        }
+    }
+}
@@ -0,0 +1,182 @@
+// File: block_cache.hpp
+//
+// Created by Adrian Habusta on 17.10.2026
+//
+
+#ifndef SEMESTER_PROJECT_BLOCK_CACHE_HPP
+#define SEMESTER_PROJECT_BLOCK_CACHE_HPP
+
+#include <unordered_map>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "../utility.hpp"
+#include "registers.hpp"
+
+namespace central_processing_unit {
+    class cpu;
+    struct decoded_instruction;
+
+    // Code generated by the JIT for one block, returns how many instructions were executed
+    using jit_function = std::size_t (*)(cpu* self, registers::register_file* registers,
+                                         const decoded_instruction* instructions);
+
+    // Short instruction sequences that are executed together, without going back through the dispatcher
+    enum class fused_sequence : byte {
+        none,
+        // LD A,(HL+) / CP n / JR NZ,e
+        load_increment_compare_branch,
+        // LDH A,(n) / CP n / JR NZ,e or JR Z,e
+        load_high_compare_branch,
+        // DEC r / JR NZ,e
+        decrement_branch,
+    };
+
+    // How many instructions the sequence is made of
+    constexpr int get_fused_length(fused_sequence sequence) {
+        switch (sequence) {
+            case fused_sequence::none: return 1;
+            case fused_sequence::decrement_branch: return 2;
+            default: return 3;
+        }
+    }
+
+    struct decoded_instruction {
+        word address;
+        byte opcode;
+        byte length;
+        // The immediate operand, already read from ROM
+        word immediate;
+        // Without taken branches
+        byte machine_cycles;
+        fused_sequence fused{fused_sequence::none};
+    };
+
+    // A straight run of ROM instructions that ends with the first instruction that can change control flow. The raw
+    // bytes are kept as well, so that opcode and operand fetches inside the block don't go through the memory map.
+    struct basic_block {
+        int bank{};
+        word start_address{};
+        std::vector<byte> bytes;
+        std::vector<decoded_instruction> instructions;
+        unsigned machine_cycles{};
+
+        // Only used when built with CPU_JIT
+        std::uint32_t execution_count{};
+        jit_function compiled{nullptr};
+        bool jit_rejected{false};
+
+        [[nodiscard]] bool contains(word address) const {
+            return static_cast<word>(address - start_address) < bytes.size();
+        }
+        [[nodiscard]] byte read(word address) const { return bytes[address - start_address]; }
+    };
+
+    // Blocks are keyed by (ROM bank, address). ROM never changes, so switching banks doesn't throw anything away, it
+    // only changes which blocks are found. Code outside ROM (WRAM, HRAM) is never cached, since it can be rewritten.
+    class block_cache {
+        static constexpr word rom_end_address = 0x7FFF;
+        static constexpr word switchable_bank_start_address = 0x4000;
+        static constexpr word boot_rom_end_address = 0x00FF;
+        static constexpr int max_instructions_per_block = 32;
+
+        std::unordered_map<dword, basic_block> blocks;
+        // Last block seen at each address, checked before the map. Entries from another bank just miss.
+        std::array<basic_block*, rom_end_address + 1> recent_blocks{};
+
+        static dword make_key(int bank, word address) {
+            return (static_cast<dword>(bank) << 16) | address;
+        }
+
+        static void mark_fused_sequences(basic_block& block);
+
+    public:
+        // Banks as reported by the cartridge. The boot ROM overlay gets its own key.
+        static constexpr int boot_rom_bank = 0xFFFF;
+
+        std::uint64_t block_hits{};
+        std::uint64_t block_misses{};
+        std::uint64_t fused_executions{};
+
+        [[nodiscard]] static bool is_cacheable(word address) { return address <= rom_end_address; }
+        [[nodiscard]] static bool ends_block(byte opcode);
+        // Last address that is still in the same ROM bank
+        [[nodiscard]] static word get_region_end(word address, int bank);
+
+        [[nodiscard]] static byte get_instruction_length(byte opcode);
+        [[nodiscard]] static byte get_machine_cycles(byte opcode, byte cb_opcode);
+
+        basic_block* find(int bank, word address) {
+            basic_block* recent = recent_blocks[address];
+            if (recent != nullptr && recent->bank == bank) {
+                ++block_hits;
+                return recent;
+            }
+
+            auto it = blocks.find(make_key(bank, address));
+            if (it == blocks.end())
+                return nullptr;
+
+            ++block_hits;
+            recent_blocks[address] = &it->second;
+            return &it->second;
+        }
+
+        // read_rom must read without side effects and without cycling
+        template<typename rom_reader>
+        basic_block& decode(int bank, word address, rom_reader&& read_rom) {
+            ++block_misses;
+
+            basic_block block{};
+            block.bank = bank;
+            block.start_address = address;
+
+            word region_end = get_region_end(address, bank);
+            word current_address = address;
+
+            while (block.instructions.size() < max_instructions_per_block) {
+                byte opcode = read_rom(current_address);
+                byte length = get_instruction_length(opcode);
+
+                if (current_address + length - 1 > region_end)
+                    break;
+
+                byte operand_low = length > 1 ? read_rom(current_address + 1) : 0;
+                byte operand_high = length > 2 ? read_rom(current_address + 2) : 0;
+
+                decoded_instruction instruction{
+                    current_address,
+                    opcode,
+                    length,
+                    utility::get_word_from_bytes(operand_low, operand_high),
+                    get_machine_cycles(opcode, operand_low)
+                };
+
+                block.instructions.push_back(instruction);
+                block.machine_cycles += instruction.machine_cycles;
+                for (int i = 0; i < length; ++i)
+                    block.bytes.push_back(read_rom(current_address + i));
+
+                current_address += length;
+
+                if (ends_block(opcode))
+                    break;
+            }
+
+            mark_fused_sequences(block);
+
+            basic_block& inserted = blocks.insert_or_assign(make_key(bank, address), std::move(block)).first->second;
+            recent_blocks[address] = &inserted;
+
+            return inserted;
+        }
+
+        void clear() {
+            blocks.clear();
+            recent_blocks.fill(nullptr);
+        }
+    };
+}
+
+#endif //SEMESTER_PROJECT_BLOCK_CACHE_HPP
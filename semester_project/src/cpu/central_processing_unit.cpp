@@ -3,33 +3,80 @@
 // Created by Adrian Habusta on 19.04.2023
 //
 
-#include "central_processing_unit.hpp"
-
-#include <utility>
+#include <cstdio>
+#include <string>
 
-#include <utility>
+#include "central_processing_unit.hpp"
+#include "../emulator.hpp"
 #include "../utility.hpp"
 
 namespace central_processing_unit {
-    cpu::cpu(memory_read_callback&& read_memory, memory_write_callback&& write_memory,
-             cycle_callback&& run_phantom_cycle)
-        : read_memory(std::move(read_memory)), write_memory(std::move(write_memory)),
-          run_phantom_cycle(std::move(run_phantom_cycle)) {
-    };
-
     void cpu::execute() {
+        return_requested = false;
+
         switch (current_state) {
             case state::running: execute_running_state(); break;
             case state::halted: execute_halted_state(); break;
             case state::crashed: execute_crashed_state(); break;
+            case state::stopped: break;
 
             // Can't occur
             default: break;
         }
     }
 
-    void cpu::execute_running_state() {
-        execute_instruction(cached_instruction);
+    void cpu::step() {
+        switch (current_state) {
+            case state::running: execute_running_step(); break;
+            case state::halted: execute_halted_state(); break;
+            case state::crashed: execute_crashed_state(); break;
+            case state::stopped: break;
+
+            // Can't occur
+            default: break;
+        }
+    }
+
+    void cpu::step_instruction() {
+        switch (current_state) {
+            case state::running: dispatch_instruction(cached_instruction); break;
+            case state::halted: execute_halted_state(); break;
+            case state::crashed: execute_crashed_state(); break;
+            case state::stopped: break;
+
+            // Can't occur
+            default: break;
+        }
+    }
+
+    bool cpu::has_same_state(const cpu& other) const {
+        const auto& ours = registers.whole;
+        const auto& theirs = other.registers.whole;
+
+        // Flags are compared as the CPU sees them, F itself can be stale with CPU_LAZY_FLAGS
+        auto af = registers::whole_register_name::AF;
+
+        return registers.read_from_register(af) == other.registers.read_from_register(af) &&
+               ours.BC == theirs.BC && ours.DE == theirs.DE && ours.HL == theirs.HL &&
+               ours.SP == theirs.SP && ours.PC == theirs.PC &&
+               cached_instruction == other.cached_instruction &&
+               interrupt_master_enable == other.interrupt_master_enable &&
+               interrupt_enable_register == other.interrupt_enable_register &&
+               interrupt_requested_register == other.interrupt_requested_register &&
+               current_state == other.current_state;
+    }
+
+    std::string cpu::describe_state() const {
+        const auto& r = registers.whole;
+        word af = registers.read_from_register(registers::whole_register_name::AF);
+
+        char description[128];
+        std::snprintf(description, sizeof(description),
+                      "AF=%04X BC=%04X DE=%04X HL=%04X SP=%04X PC=%04X op=%02X IME=%d IE=%02X IF=%02X state=%d",
+                      af, r.BC, r.DE, r.HL, r.SP, r.PC, cached_instruction, interrupt_master_enable,
+                      interrupt_enable_register, interrupt_requested_register, static_cast<int>(current_state));
+
+        return description;
     }
 
     void cpu::execute_halted_state() {
@@ -40,6 +87,8 @@ namespace central_processing_unit {
             return;
         }
 
+        // Nothing can wake the CPU up before the next event, so the cycles until then are run in bulk
+        bus.run_until_next_event();
         run_phantom_cycle();
     }
 
@@ -60,7 +109,40 @@ namespace central_processing_unit {
         }
     }
 
-    cpu::interrupt_type cpu::check_for_interrupts() const {
+    basic_block* cpu::find_or_decode_block(word address) {
+        // Code in RAM can be rewritten at any time, and reads during DMA don't see ROM at all
+        if (!block_cache::is_cacheable(address) || bus.is_dma_active())
+            return nullptr;
+
+        int bank = bus.get_rom_bank(address);
+
+        if (basic_block* block = cached_blocks.find(bank, address))
+            return block;
+
+        return &cached_blocks.decode(bank, address, [this](word rom_address) { return bus.peek_rom(rom_address); });
+    }
+
+    void cpu::check_for_idle_loop(word branch_address, word target_address) {
+        // Code outside ROM can be rewritten, and an interrupt might have been serviced instead of the jump
+        if (!block_cache::is_cacheable(branch_address) || registers.whole.PC != static_cast<word>(target_address + 1))
+            return;
+
+        int bank = bus.get_rom_bank(target_address);
+        auto read_rom = [this](word rom_address) { return bus.peek_rom(rom_address); };
+
+        const idle_loop& loop = idle_loops.find_or_analyze(bank, target_address, branch_address, read_rom);
+        if (!loop.is_idle)
+            return;
+
+        std::size_t skipped = idle_loops.get_skippable_machine_cycles(loop, registers,
+                                                                      bus.get_machine_cycle_count(),
+                                                                      bus.get_machine_cycles_to_next_event(),
+                                                                      serviced_interrupts);
+        if (skipped > 0)
+            bus.fast_forward(skipped);
+    }
+
+    interrupt_type cpu::check_for_interrupts() const {
         // Interrupts are serviced with priority going from interrupt in bit 0 -> bit 4
         for (int i = 0; i < interrupt_types_count; ++i) {
             bool interrupt_requested = utility::get_bit(interrupt_requested_register, i);
@@ -80,6 +162,7 @@ namespace central_processing_unit {
             return;
 
         acknowledge_interrupt(interrupt);
+        ++serviced_interrupts;
 
         interrupt_master_enable = false;
         word interrupt_handler_address = interrupt_jump_targets[interrupt];
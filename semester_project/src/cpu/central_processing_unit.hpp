@@ -6,25 +6,81 @@
 #ifndef SEMESTER_PROJECT_CENTRAL_PROCESSING_UNIT_HPP
 #define SEMESTER_PROJECT_CENTRAL_PROCESSING_UNIT_HPP
 
-#include <functional>
+#include <memory>
+#include <string>
+#include <array>
+#include <utility>
 
+#include "../machine_state.hpp"
 #include "../utility.hpp"
 #include "registers.hpp"
+#include "block_cache.hpp"
+#include "jit_compiler.hpp"
+#include "idle_loop_detector.hpp"
+
+// The JIT compiles the blocks found by the block cache
+#if defined(CPU_JIT) && !defined(CPU_BLOCK_CACHE)
+#error "CPU_JIT requires CPU_BLOCK_CACHE"
+#endif
+
+namespace emulator {
+    // Defined in emulator.hpp. The CPU translation units include it, so every memory access and cycle can be inlined
+    // all the way down to the components.
+    class cpu_bus;
+}
 
 namespace central_processing_unit {
     constexpr int high_page = 0xFF00;
     constexpr word interrupt_jump_targets[] = { 0x40, 0x48, 0x50, 0x58, 0x60 };
     constexpr int interrupt_types_count = 5;
 
-    class cpu {
-        using memory_read_callback = std::function<byte(word)>;
-        using memory_write_callback = std::function<void(word, byte)>;
-        using cycle_callback = std::function<void()>;
+    // Not class so that we can easily use it as a number
+    enum interrupt_type {
+        none = -1,
+        vblank = 0,
+        lcd_stat = 1,
+        timer = 2,
+        serial = 3,
+        joypad = 4,
+    };
 
+    class cpu {
     public:
-        cpu(memory_read_callback&& read_memory, memory_write_callback&& write_memory,
-            cycle_callback&& run_phantom_cycle);
+        explicit cpu(emulator::cpu_bus& bus) : bus(bus) {}
+        // Runs until the CPU leaves the running state, or the emulator calls request_return
         void execute();
+        // Executes a single block, or a single instruction when the block cache isn't used
+        void step();
+        // Always a single instruction, used when there are breakpoints
+        void step_instruction();
+
+        // Checked between instructions, and between the blocks of the block cache
+        void request_return() { return_requested = true; }
+
+        // STOP leaves the CPU in this state until the emulator wakes it up
+        [[nodiscard]] bool is_stopped() const { return current_state == state::stopped; }
+        void wake_up_from_stop() { current_state = state::running; }
+
+        // The opcode was already prefetched, so PC points past it
+        [[nodiscard]] word get_next_instruction_address() const { return registers.whole.PC - 1; }
+        [[nodiscard]] bool is_running() const { return current_state == state::running; }
+
+        // Only has an effect when built with CPU_JIT, where it is enabled by default
+        void set_jit_enabled(bool enabled) { jit_enabled = enabled; }
+        [[nodiscard]] const jit_compiler* get_jit() const { return jit.get(); }
+        [[nodiscard]] const idle_loop_detector& get_idle_loops() const { return idle_loops; }
+
+        // Used to compare the JIT against the interpreter
+        [[nodiscard]] bool has_same_state(const cpu& other) const;
+
+        // The caches only depend on the ROM, so they are valid after the state changes, as long as the ROM mapping
+        // generation does too. Only the idle loop detector has to forget what it saw before.
+        void forget_history() { idle_loops.forget_last_visit(); }
+        template<typename visitor> void visit_state(visitor& visit) {
+            machine_state::visit_members(visit, registers, cached_instruction, interrupt_master_enable, current_state,
+                                         interrupt_enable_register, interrupt_requested_register);
+        }
+        [[nodiscard]] std::string describe_state() const;
 
         byte interrupt_enable_register{};
         byte interrupt_requested_register{};
@@ -40,38 +96,120 @@ namespace central_processing_unit {
         registers::register_file registers{};
         byte cached_instruction{0x00};
 
-        memory_read_callback read_memory;
-        memory_write_callback write_memory;
+        emulator::cpu_bus& bus;
 
-        cycle_callback run_phantom_cycle;
         bool interrupt_master_enable = true;
 
         enum class state {
             running,
             halted,
+            stopped,
             crashed
         };
 
         state current_state = state::running;
+        bool return_requested{false};
 
         void crash() { current_state = state::crashed; };
 
+        // Runs instructions until the CPU leaves the running state
         void execute_running_state();
+        void execute_running_step();
         void execute_halted_state();
         void execute_crashed_state();
 
         void execute_instruction(byte instruction);
+        // Goes through whichever dispatcher the build uses
+        void dispatch_instruction(byte instruction);
+
+        // Used by the table and threaded dispatchers, see cpu_execute_table.cpp
+        template<byte opcode> void execute_opcode();
+        template<byte opcode> void execute_cb_opcode();
+
+        // Opcodes with an 8-bit register operand are generated from the operand's encoding, the rest are written out
+        // in execute_instruction
+        static constexpr bool has_generated_handler(byte opcode) {
+            bool is_load = opcode >= 0x40 && opcode < 0x80 && opcode != 0x76;
+            bool is_alu = opcode >= 0x80 && opcode < 0xC0;
+            // INC r, DEC r and LD r,n
+            bool is_register_column = opcode < 0x40 && (opcode & 0x07) >= 0x04 && (opcode & 0x07) <= 0x06;
+
+            return is_load || is_alu || is_register_column;
+        }
+        template<int operand> byte read_operand();
+        template<int operand> void write_operand(byte value);
+        template<int operation> void execute_alu(byte value);
+
+        using opcode_table = std::array<void (cpu::*)(), 256>;
+        template<std::size_t... opcodes>
+        static constexpr opcode_table make_opcode_table(std::index_sequence<opcodes...>);
+        template<std::size_t... opcodes>
+        static constexpr opcode_table make_cb_opcode_table(std::index_sequence<opcodes...>);
         void prefetch_next_instruction_and_handle_interrupts();
 
-        // Not class so that we can easily use it as a number
-        enum interrupt_type {
-            none = -1,
-            vblank = 0,
-            lcd_stat = 1,
-            timer = 2,
-            serial = 3,
-            joypad = 4,
-        };
+        //
+        // Block cache, only used when built with CPU_BLOCK_CACHE
+        //
+        block_cache cached_blocks;
+
+        // Opcode and operand fetches that hit this block are served from it, instead of going through the memory map.
+        // The bus still runs the same machine cycle for each of them.
+        const basic_block* fetch_block{nullptr};
+        dword fetch_block_generation{};
+
+        basic_block* find_or_decode_block(word address);
+        // Returns how many instructions were executed, stops as soon as the CPU leaves the block
+        std::size_t execute_block(basic_block& block);
+        // Checks that the CPU is about to execute exactly this instruction, from the same ROM mapping
+        bool is_at(const decoded_instruction& instruction);
+
+        // Used instead of operand fetches, the value was already read when the block was decoded
+        byte read_decoded_immediate(const decoded_instruction& instruction) {
+            run_phantom_cycle();
+            inc_pc();
+            return utility::get_low_byte(instruction.immediate);
+        }
+
+        // Return how many of the instructions were executed, fewer than all of them if an interrupt came in
+        int execute_load_increment_compare_branch(const decoded_instruction* instructions);
+        int execute_load_high_compare_branch(const decoded_instruction* instructions);
+        int execute_decrement_branch(const decoded_instruction* instructions);
+        int execute_fused(const decoded_instruction* instructions);
+
+        //
+        // JIT, only used when built with CPU_JIT
+        //
+#if defined(CPU_JIT)
+        bool jit_enabled = true;
+#else
+        bool jit_enabled = false;
+#endif
+        // Created on first use, so that CPUs that never compile anything don't map executable memory
+        std::unique_ptr<jit_compiler> jit;
+
+        std::size_t execute_compiled_block(basic_block& block);
+
+        // Entry points for the generated code, see jit_compiler.hpp
+        static const jit_entry_points jit_entries;
+
+        static bool jit_is_at(cpu* self, const decoded_instruction* instruction);
+        static void jit_prefetch(cpu* self);
+        static void jit_skip_immediate(cpu* self);
+        static int jit_execute_fused(cpu* self, const decoded_instruction* instruction);
+        template<byte opcode> static void jit_execute_opcode(cpu* self);
+
+        template<std::size_t... opcodes>
+        static constexpr jit_entry_points make_jit_entry_points(std::index_sequence<opcodes...>);
+        //
+        // End of block cache and JIT
+        //
+
+        idle_loop_detector idle_loops;
+        // Lets the idle loop detector tell whether an interrupt came in during an iteration
+        std::size_t serviced_interrupts{};
+
+        // Called after a taken backward jump, fast-forwards the emulator if the CPU is spinning in an idle loop
+        void check_for_idle_loop(word branch_address, word target_address);
 
         [[nodiscard]] interrupt_type check_for_interrupts() const;
         void acknowledge_interrupt(interrupt_type);
@@ -80,7 +218,7 @@ namespace central_processing_unit {
         //
         // Memory access methods
         //
-        byte read_byte(word address) { return read_memory(address); }
+        byte read_byte(word address);
 
         byte read_byte_at_pc_and_increment() {
             byte val = read_byte_at_pc();
@@ -95,9 +233,9 @@ namespace central_processing_unit {
             return utility::get_word_from_bytes(low, high);
         }
 
-        byte read_byte_at_pc() { return read_byte(registers.whole.PC); }
+        byte read_byte_at_pc();
 
-        void write_byte(word address, byte value) { write_memory(address, value); }
+        void write_byte(word address, byte value);
         void write_word(word address, word value) {
             write_byte(address, utility::get_low_byte(value));
             write_byte(address + 1, utility::get_high_byte(value));
@@ -125,6 +263,10 @@ namespace central_processing_unit {
 
         void inc_pc() { registers.whole.PC++; }
 
+        // Memory accesses take one machine cycle each, phantom cycles are internal CPU cycles which only advance the
+        // other components. These are defined inline in emulator.hpp, together with read_byte_at_pc.
+        void run_phantom_cycle();
+
         //
         // End of memory access methods
         //
@@ -162,12 +304,8 @@ namespace central_processing_unit {
         void cp(byte value);
 
         byte shared_inc_dec(byte value, byte offset, bool subtract_flag);
-        void inc(registers::half_register_name target_register);
-        void inc(word target_address);
         void inc(registers::whole_register_name target_register);
 
-        void dec(registers::half_register_name target_register);
-        void dec(word target_address);
         void dec(registers::whole_register_name target_register);
 
         void set_carry_flag(bool value);
@@ -204,38 +342,18 @@ namespace central_processing_unit {
         void rotate_a_right(bool added_bit);
         void rotate_a_left(bool added_bit);
 
-        void rlc(registers::half_register_name target_register);
-        void rlc(word target_address);
-
-        void rl(registers::half_register_name target_register);
-        void rl(word target_address);
-
-        void rrc(registers::half_register_name target_register);
-        void rrc(word target_address);
-
-        void rr(registers::half_register_name target_register);
-        void rr(word target_address);
-
-        void sla(registers::half_register_name target_register);
-        void sla(word target_address);
-
-        void sra(registers::half_register_name target_register);
-        void sra(word target_address);
-
-        void srl(registers::half_register_name target_register);
-        void srl(word target_address);
-
-        void swap(registers::half_register_name target_register);
-        void swap(word target_address);
-
-        void bit(int bit, registers::half_register_name target_register);
-        void bit(int bit, word target_address);
-
-        void set(int bit, registers::half_register_name target_register);
-        void set(int bit, word target_address);
-
-        void res(int bit, registers::half_register_name target_register);
-        void res(int bit, word target_address);
+        // Return the result, execute_cb_opcode writes it back to the operand. SET and RES need no flags, so they
+        // don't have a method.
+        byte rlc(byte value);
+        byte rl(byte value);
+        byte rrc(byte value);
+        byte rr(byte value);
+        byte sla(byte value);
+        byte sra(byte value);
+        byte srl(byte value);
+        byte swap(byte value);
+
+        void bit(int bit, byte value);
     };
 }
 
@@ -50,10 +50,7 @@ namespace central_processing_unit {
     void cpu::add(byte value, bool carry) {
         byte result = registers.half.A + value + carry;
 
-        registers.write_zero_flag(result == 0);
-        registers.write_subtract_flag(false);
-        registers.write_half_carry_flag(utility::get_bit((registers.half.A & 0xF) + (value & 0xF) + carry, 4));
-        registers.write_carry_flag(((word)registers.half.A + (word)value + carry) > 0xFF);
+        registers.write_flags_from_operation(registers::flag_operation::add, registers.half.A, value, carry, result);
 
         registers.half.A = result;
 
@@ -76,10 +73,8 @@ namespace central_processing_unit {
     word cpu::add_signed_to_sp(byte value) {
         word sign_extended_value = utility::sign_extend_byte_to_word(value);
 
-        registers.write_zero_flag(false);
-        registers.write_subtract_flag(false);
-        registers.write_half_carry_flag(utility::get_bit((registers.whole.SP & 0xF) + (value & 0xF), 4));
-        registers.write_carry_flag(utility::get_bit((registers.whole.SP & 0xFF) + (value & 0xFF), 8));
+        registers.write_flags(false, false, utility::get_bit((registers.whole.SP & 0xF) + (value & 0xF), 4),
+                              utility::get_bit((registers.whole.SP & 0xFF) + (value & 0xFF), 8));
 
         word result = registers.whole.SP + sign_extended_value;
 
@@ -101,10 +96,8 @@ namespace central_processing_unit {
     byte cpu::subtract(byte value, bool carry) {
         byte result = registers.half.A - value - carry;
 
-        registers.write_zero_flag(result == 0);
-        registers.write_subtract_flag(true);
-        registers.write_half_carry_flag(utility::get_bit((registers.half.A & 0xF) - (value & 0xF) - carry, 4));
-        registers.write_carry_flag((word)registers.half.A < ((word)value + carry));
+        registers.write_flags_from_operation(registers::flag_operation::subtract, registers.half.A, value, carry,
+                                             result);
 
         return result;
         // No prefetch, this is a shared instruction
@@ -124,10 +117,7 @@ namespace central_processing_unit {
     void cpu::and_(byte value) {
         registers.half.A &= value;
 
-        registers.write_zero_flag(registers.half.A == 0);
-        registers.write_subtract_flag(false);
-        registers.write_half_carry_flag(true);
-        registers.write_carry_flag(false);
+        registers.write_flags_from_operation(registers::flag_operation::and_, 0, 0, false, registers.half.A);
 
         prefetch_next_instruction_and_handle_interrupts();
     }
@@ -135,10 +125,7 @@ namespace central_processing_unit {
     void cpu::or_(byte value) {
         registers.half.A |= value;
 
-        registers.write_zero_flag(registers.half.A == 0);
-        registers.write_subtract_flag(false);
-        registers.write_half_carry_flag(false);
-        registers.write_carry_flag(false);
+        registers.write_flags_from_operation(registers::flag_operation::bitwise, 0, 0, false, registers.half.A);
 
         prefetch_next_instruction_and_handle_interrupts();
     }
@@ -146,10 +133,7 @@ namespace central_processing_unit {
     void cpu::xor_(byte value) {
         registers.half.A ^= value;
 
-        registers.write_zero_flag(registers.half.A == 0);
-        registers.write_subtract_flag(false);
-        registers.write_half_carry_flag(false);
-        registers.write_carry_flag(false);
+        registers.write_flags_from_operation(registers::flag_operation::bitwise, 0, 0, false, registers.half.A);
 
         prefetch_next_instruction_and_handle_interrupts();
     }
@@ -164,31 +148,13 @@ namespace central_processing_unit {
     byte cpu::shared_inc_dec(byte value, byte offset, bool subtract_flag) {
         byte result = value + offset;
 
-        registers.write_zero_flag(result == 0);
-        registers.write_subtract_flag(subtract_flag);
-        registers.write_half_carry_flag(utility::get_bit((value & 0xF) + offset, 4));
+        // Carry is left as it was
+        auto operation = subtract_flag ? registers::flag_operation::decrement : registers::flag_operation::increment;
+        registers.write_flags_from_operation(operation, value, 0, registers.read_carry_flag(), result);
 
         return result;
     }
 
-    void cpu::inc(registers::half_register_name target_register) {
-        byte value = registers.read_from_register(target_register);
-
-        byte result = shared_inc_dec(value, 0x01, false);
-        registers.write_to_register(target_register, result);
-
-        prefetch_next_instruction_and_handle_interrupts();
-    }
-
-    void cpu::inc(word target_address) {
-        byte value = read_byte(target_address);
-
-        byte result = shared_inc_dec(value, 0x01, false);
-        write_byte(target_address, result);
-
-        prefetch_next_instruction_and_handle_interrupts();
-    }
-
     // for some reason this does not affect any flags
     void cpu::inc(registers::whole_register_name target_register) {
         word value = registers.read_from_register(target_register);
@@ -201,24 +167,6 @@ namespace central_processing_unit {
         prefetch_next_instruction_and_handle_interrupts();
     }
 
-    void cpu::dec(registers::half_register_name target_register) {
-        byte value = registers.read_from_register(target_register);
-
-        byte result = shared_inc_dec(value, -1, true);
-        registers.write_to_register(target_register, result);
-
-        prefetch_next_instruction_and_handle_interrupts();
-    }
-
-    void cpu::dec(word target_address) {
-        byte value = read_byte(target_address);
-
-        byte result = shared_inc_dec(value, -1, true);
-        write_byte(target_address, result);
-
-        prefetch_next_instruction_and_handle_interrupts();
-    }
-
     void cpu::dec(registers::whole_register_name target_register) {
         word value = registers.read_from_register(target_register);
 
@@ -283,24 +231,36 @@ namespace central_processing_unit {
     }
 
     void cpu::jump(word address, bool condition) {
+        // PC is already past the 3 byte instruction
+        word branch_address = registers.whole.PC - 3;
+
         if (condition) {
             run_phantom_cycle();
             registers.whole.PC = address;
         }
 
         prefetch_next_instruction_and_handle_interrupts();
+
+        if (condition && address <= branch_address)
+            check_for_idle_loop(branch_address, address);
     }
 
     void cpu::jump_relative(byte offset, bool condition) {
-        if (condition) {
-            word sign_extended_offset = utility::sign_extend_byte_to_word(offset);
-            word result = registers.whole.PC + sign_extended_offset;
+        // PC is already past the 2 byte instruction
+        word branch_address = registers.whole.PC - 2;
+
+        word sign_extended_offset = utility::sign_extend_byte_to_word(offset);
+        word result = registers.whole.PC + sign_extended_offset;
 
+        if (condition) {
             run_phantom_cycle();
             registers.whole.PC = result;
         }
 
         prefetch_next_instruction_and_handle_interrupts();
+
+        if (condition && result <= branch_address)
+            check_for_idle_loop(branch_address, result);
     }
 
     void cpu::call(word address, bool condition) {
@@ -355,8 +315,10 @@ namespace central_processing_unit {
         fetch_instruction();
         if (cached_instruction != 0x00) {
             crash();
+            return;
         }
-        throw emulator::stop{};
+
+        current_state = state::stopped;
     }
     void cpu::halt() {
         fetch_instruction();
@@ -380,10 +342,7 @@ namespace central_processing_unit {
     byte cpu::shared_shift_in_value_left(byte value, bool bit) {
         byte result = value << 1 | bit;
 
-        registers.write_zero_flag(result == 0);
-        registers.write_subtract_flag(false);
-        registers.write_half_carry_flag(false);
-        registers.write_carry_flag((value & 0x80) != 0);
+        registers.write_flags_from_operation(registers::flag_operation::bitwise, 0, 0, (value & 0x80) != 0, result);
 
         return result;
     }
@@ -391,223 +350,137 @@ namespace central_processing_unit {
     byte cpu::shared_shift_in_value_right(byte value, bool bit) {
         byte result = value >> 1 | (bit << 7);
 
-        registers.write_zero_flag(result == 0);
-        registers.write_subtract_flag(false);
-        registers.write_half_carry_flag(false);
-        registers.write_carry_flag((value & 0x01) != 0);
+        registers.write_flags_from_operation(registers::flag_operation::bitwise, 0, 0, (value & 0x01) != 0, result);
 
         return result;
     }
 
     void cpu::rotate_a_left(bool added_bit) {
-        byte result = shared_shift_in_value_left(registers.half.A, added_bit);
-        registers.write_zero_flag(false);
+        byte value = registers.half.A;
+        byte result = value << 1 | added_bit;
+
+        // Unlike the CB prefixed rotations, these always clear Z
+        registers.write_flags(false, false, false, (value & 0x80) != 0);
         registers.half.A = result;
 
         prefetch_next_instruction_and_handle_interrupts();
     }
 
     void cpu::rotate_a_right(bool added_bit) {
-        byte result = shared_shift_in_value_right(registers.half.A, added_bit);
-        registers.write_zero_flag(false);
+        byte value = registers.half.A;
+        byte result = value >> 1 | (added_bit << 7);
+
+        // Unlike the CB prefixed rotations, these always clear Z
+        registers.write_flags(false, false, false, (value & 0x01) != 0);
         registers.half.A = result;
 
         prefetch_next_instruction_and_handle_interrupts();
     }
 
 
-    void cpu::rlc(registers::half_register_name target_register) {
-        byte value = registers.read_from_register(target_register);
-
-        bool added_bit = utility::get_bit(value, 7);
-        byte result = shared_shift_in_value_left(value, added_bit);
-
-        registers.write_to_register(target_register, result);
+    byte cpu::rlc(byte value) {
+        return shared_shift_in_value_left(value, utility::get_bit(value, 7));
     }
 
-    void cpu::rlc(word address) {
-        byte value = read_byte(address);
-
-        bool added_bit = utility::get_bit(value, 7);
-        byte result = shared_shift_in_value_left(value, added_bit);
-
-        write_byte(address, result);
+    byte cpu::rl(byte value) {
+        return shared_shift_in_value_left(value, registers.read_carry_flag());
     }
 
-
-    void cpu::rl(registers::half_register_name target_register) {
-        byte value = registers.read_from_register(target_register);
-
-        bool added_bit = registers.read_carry_flag();
-        byte result = shared_shift_in_value_left(value, added_bit);
-
-        registers.write_to_register(target_register, result);
+    byte cpu::rrc(byte value) {
+        return shared_shift_in_value_right(value, utility::get_bit(value, 0));
     }
 
-    void cpu::rl(word address) {
-        byte value = read_byte(address);
-
-        bool added_bit = registers.read_carry_flag();
-        byte result = shared_shift_in_value_left(value, added_bit);
-
-        write_byte(address, result);
+    byte cpu::rr(byte value) {
+        return shared_shift_in_value_right(value, registers.read_carry_flag());
     }
 
-
-    void cpu::rrc(registers::half_register_name target_register) {
-        byte value = registers.read_from_register(target_register);
-
-        bool added_bit = utility::get_bit(value, 0);
-        byte result = shared_shift_in_value_right(value, added_bit);
-
-        registers.write_to_register(target_register, result);
+    byte cpu::sla(byte value) {
+        return shared_shift_in_value_left(value, false);
     }
 
-    void cpu::rrc(word address) {
-        byte value = read_byte(address);
-
-        bool added_bit = utility::get_bit(value, 0);
-        byte result = shared_shift_in_value_right(value, added_bit);
-
-        write_byte(address, result);
+    byte cpu::sra(byte value) {
+        return shared_shift_in_value_right(value, utility::get_bit(value, 7));
     }
 
-
-    void cpu::rr(registers::half_register_name target_register) {
-        byte value = registers.read_from_register(target_register);
-
-        bool added_bit = registers.read_carry_flag();
-        byte result = shared_shift_in_value_right(value, added_bit);
-
-        registers.write_to_register(target_register, result);
-    }
-
-    void cpu::rr(word address) {
-        byte value = read_byte(address);
-
-        bool added_bit = registers.read_carry_flag();
-        byte result = shared_shift_in_value_right(value, added_bit);
-
-        write_byte(address, result);
-    }
-
-    void cpu::sla(registers::half_register_name target_register) {
-        byte value = registers.read_from_register(target_register);
-
-        bool added_bit = false;
-        byte result = shared_shift_in_value_left(value, added_bit);
-
-        registers.write_to_register(target_register, result);
-    }
-
-    void cpu::sla(word address) {
-        byte value = read_byte(address);
-
-        bool added_bit = false;
-        byte result = shared_shift_in_value_left(value, added_bit);
-
-        write_byte(address, result);
-    }
-
-
-    void cpu::sra(registers::half_register_name target_register) {
-        byte value = registers.read_from_register(target_register);
-
-        bool added_bit = utility::get_bit(value, 7);
-        byte result = shared_shift_in_value_right(value, added_bit);
-
-        registers.write_to_register(target_register, result);
+    byte cpu::srl(byte value) {
+        return shared_shift_in_value_right(value, false);
     }
 
-    void cpu::sra(word address) {
-        byte value = read_byte(address);
+    byte cpu::swap(byte value) {
+        byte result = (value << 4) | (value >> 4);
 
-        bool added_bit = utility::get_bit(value, 7);
-        byte result = shared_shift_in_value_right(value, added_bit);
+        registers.write_flags_from_operation(registers::flag_operation::bitwise, 0, 0, false, result);
 
-        write_byte(address, result);
+        return result;
     }
 
-
-    void cpu::srl(registers::half_register_name target_register) {
-        byte value = registers.read_from_register(target_register);
-
-        bool added_bit = false;
-        byte result = shared_shift_in_value_right(value, added_bit);
-
-        registers.write_to_register(target_register, result);
+    void cpu::bit(int bit, byte value) {
+        // Same flags as AND with the bit's mask, except that carry is left as it was
+        byte result = value & (1 << bit);
+        registers.write_flags_from_operation(registers::flag_operation::and_, 0, 0, registers.read_carry_flag(),
+                                             result);
     }
 
-    void cpu::srl(word address) {
-        byte value = read_byte(address);
+    // Fused sequences from the block cache. They do exactly what the separate instructions would, with the same
+    // memory accesses in the same order, they only skip the dispatch and the operand fetches through the memory map.
 
-        bool added_bit = false;
-        byte result = shared_shift_in_value_right(value, added_bit);
-
-        write_byte(address, result);
-    }
+    int cpu::execute_load_increment_compare_branch(const decoded_instruction* instructions) {
+        load(registers::half_register_name::A, read_byte(registers.whole.HL++));
+        if (!is_at(instructions[1]))
+            return 1;
 
-    void cpu::swap(registers::half_register_name target_register) {
-        byte value = registers.read_from_register(target_register);
+        cp(read_decoded_immediate(instructions[1]));
+        if (!is_at(instructions[2]))
+            return 2;
 
-        byte result = (value << 4) | (value >> 4);
-        registers.write_zero_flag(result == 0);
-        registers.write_subtract_flag(false);
-        registers.write_half_carry_flag(false);
-        registers.write_carry_flag(false);
-
-        registers.write_to_register(target_register, result);
+        jump_relative(read_decoded_immediate(instructions[2]), !registers.read_zero_flag());
+        return 3;
     }
 
-    void cpu::swap(word address) {
-        byte value = read_byte(address);
+    int cpu::execute_load_high_compare_branch(const decoded_instruction* instructions) {
+        load(registers::half_register_name::A, read_byte(high_page | read_decoded_immediate(instructions[0])));
+        if (!is_at(instructions[1]))
+            return 1;
 
-        byte result = (value << 4) | (value >> 4);
-        registers.write_zero_flag(result == 0);
-        registers.write_subtract_flag(false);
-        registers.write_half_carry_flag(false);
-        registers.write_carry_flag(false);
+        cp(read_decoded_immediate(instructions[1]));
+        if (!is_at(instructions[2]))
+            return 2;
 
-        write_byte(address, result);
+        bool branch_on_zero = instructions[2].opcode == 0x28;
+        jump_relative(read_decoded_immediate(instructions[2]), registers.read_zero_flag() == branch_on_zero);
+        return 3;
     }
 
-    void cpu::bit(int bit, registers::half_register_name target_register) {
-        byte value = registers.read_from_register(target_register);
-
-        registers.write_zero_flag(utility::get_bit(value, bit) == 0);
-        registers.write_subtract_flag(false);
-        registers.write_half_carry_flag(true);
-    }
+    int cpu::execute_decrement_branch(const decoded_instruction* instructions) {
+        // DEC (HL) is never fused, so the operand is always a register
+        byte& target = registers.half.*registers::operand_registers[(instructions[0].opcode >> 3) & 0x07];
+        target = shared_inc_dec(target, -1, true);
+        prefetch_next_instruction_and_handle_interrupts();
 
-    void cpu::bit(int bit, word address) {
-        byte value = read_byte(address);
+        if (!is_at(instructions[1]))
+            return 1;
 
-        registers.write_zero_flag(utility::get_bit(value, bit) == 0);
-        registers.write_subtract_flag(false);
-        registers.write_half_carry_flag(true);
+        jump_relative(read_decoded_immediate(instructions[1]), !registers.read_zero_flag());
+        return 2;
     }
 
-    void cpu::set(int bit, registers::half_register_name target_register) {
-        byte value = registers.read_from_register(target_register);
-        value = utility::set_bit(value, bit);
-        registers.write_to_register(target_register, value);
-    }
+    int cpu::execute_fused(const decoded_instruction* instructions) {
+        int executed = 0;
+        switch (instructions[0].fused) {
+            case fused_sequence::load_increment_compare_branch:
+                executed = execute_load_increment_compare_branch(instructions); break;
+            case fused_sequence::load_high_compare_branch:
+                executed = execute_load_high_compare_branch(instructions); break;
+            case fused_sequence::decrement_branch:
+                executed = execute_decrement_branch(instructions); break;
 
-    void cpu::set(int bit, word address) {
-        byte value = read_byte(address);
-        value = utility::set_bit(value, bit);
-        write_byte(address, value);
-    }
+            default: break;
+        }
 
-    void cpu::res(int bit, registers::half_register_name target_register) {
-        byte value = registers.read_from_register(target_register);
-        value = utility::clear_bit(value, bit);
-        registers.write_to_register(target_register, value);
-    }
+        // Only sequences that ran to the end count as fused executions
+        if (executed == get_fused_length(instructions[0].fused))
+            ++cached_blocks.fused_executions;
 
-    void cpu::res(int bit, word address) {
-        byte value = read_byte(address);
-        value = utility::clear_bit(value, bit);
-        write_byte(address, value);
+        return executed;
     }
-}
\ No newline at end of file
+}
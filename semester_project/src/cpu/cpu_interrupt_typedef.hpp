@@ -6,8 +6,19 @@
 #ifndef SEMESTER_PROJECT_CPU_INTERRUPT_TYPEDEF_HPP
 #define SEMESTER_PROJECT_CPU_INTERRUPT_TYPEDEF_HPP
 
-#include <functional>
+#include "../utility.hpp"
 
-using interrupt_callback = std::function<void()>;
+// Requests a single interrupt by setting its bit in the CPU's interrupt flag register. A plain pointer and mask instead
+// of a std::function, so the components can raise interrupts without an indirect call.
+class interrupt_callback {
+    byte* interrupt_requested_register;
+    byte interrupt_mask;
+
+public:
+    interrupt_callback(byte& interrupt_requested_register, int interrupt_bit)
+        : interrupt_requested_register(&interrupt_requested_register), interrupt_mask(1 << interrupt_bit) {}
+
+    void operator()() const { *interrupt_requested_register |= interrupt_mask; }
+};
 
 #endif //SEMESTER_PROJECT_CPU_INTERRUPT_TYPEDEF_HPP
@@ -0,0 +1,168 @@
+// File: idle_loop_detector.cpp
+//
+// Created by Adrian Habusta on 17.10.2026
+//
+
+#include "idle_loop_detector.hpp"
+
+namespace central_processing_unit {
+    namespace {
+        // Register fields of the opcodes, as bits of written_registers
+        constexpr int indirect_hl_operand = 6;
+        constexpr byte get_register_bit(int operand) { return 1 << operand; }
+
+        // Indexed by bits 4-5 of the 16-bit register instructions, SP isn't tracked
+        constexpr byte register_pair_bits[] = { 0b000011, 0b001100, 0b110000, 0 };
+
+        constexpr word rom_end_address = 0x7FFF;
+        constexpr word wram_start_address = 0xC000;
+        constexpr word echo_end_address = 0xFDFF;
+        constexpr word io_start_address = 0xFF00;
+        constexpr word divider_address = 0xFF04;
+        constexpr word counter_address = 0xFF05;
+    }
+
+    bool idle_loop_detector::is_deterministic_address(word address) {
+        if (address <= rom_end_address)
+            return true;
+        if (address >= wram_start_address && address <= echo_end_address)
+            return true;
+        if (address >= io_start_address)
+            return address != divider_address && address != counter_address;
+
+        return false;
+    }
+
+    bool idle_loop_detector::add_instruction(idle_loop& loop, byte& written_registers, byte opcode, byte operand_low,
+                                             byte operand_high) {
+        int target = (opcode >> 3) & 0x07;
+        int source = opcode & 0x07;
+
+        switch (opcode) {
+            // NOP, rotations of A, DAA, CPL, SCF, CCF
+            case 0x00: case 0x07: case 0x0F: case 0x17: case 0x1F: case 0x27: case 0x2F: case 0x37: case 0x3F:
+            // ALU with immediate operand
+            case 0xC6: case 0xCE: case 0xD6: case 0xDE: case 0xE6: case 0xEE: case 0xF6: case 0xFE:
+                return true;
+
+            // LD rr,nn / INC rr / DEC rr / ADD HL,rr
+            case 0x01: case 0x11: case 0x21: case 0x31:
+            case 0x03: case 0x13: case 0x23: case 0x33:
+            case 0x0B: case 0x1B: case 0x2B: case 0x3B:
+                written_registers |= register_pair_bits[opcode >> 4];
+                return true;
+            case 0x09: case 0x19: case 0x29: case 0x39:
+                written_registers |= register_pair_bits[2];
+                return true;
+
+            // LD A,(BC) / LD A,(DE) / LD A,(C)
+            case 0x0A: loop.reads_through_bc = true; return true;
+            case 0x1A: loop.reads_through_de = true; return true;
+            case 0xF2: loop.reads_through_c = true; return true;
+
+            // LDH A,(n) / LD A,(nn)
+            case 0xF0: return is_deterministic_address(io_start_address | operand_low);
+            case 0xFA: return is_deterministic_address(utility::get_word_from_bytes(operand_low, operand_high));
+
+            case 0xCB: return add_cb_instruction(loop, written_registers, operand_low);
+
+            default: break;
+        }
+
+        // INC r / DEC r / LD r,n, the (HL) variants write to memory
+        if ((opcode & 0xC7) == 0x04 || (opcode & 0xC7) == 0x05 || (opcode & 0xC7) == 0x06) {
+            if (target == indirect_hl_operand)
+                return false;
+
+            written_registers |= get_register_bit(target);
+            return true;
+        }
+
+        // LD r,r', without HALT and LD (HL),r
+        if ((opcode & 0xC0) == 0x40) {
+            if (opcode == 0x76 || target == indirect_hl_operand)
+                return false;
+
+            if (source == indirect_hl_operand)
+                loop.reads_through_hl = true;
+            written_registers |= get_register_bit(target);
+            return true;
+        }
+
+        // ALU with register operand, these only change A and F
+        if ((opcode & 0xC0) == 0x80) {
+            if (source == indirect_hl_operand)
+                loop.reads_through_hl = true;
+            return true;
+        }
+
+        // Writes, stack accesses, control flow and interrupt changes
+        return false;
+    }
+
+    bool idle_loop_detector::add_cb_instruction(idle_loop& loop, byte& written_registers, byte cb_opcode) {
+        constexpr byte bit_group = 1;
+
+        int operand = cb_opcode & 0x07;
+        bool is_bit = (cb_opcode >> 6) == bit_group;
+
+        if (operand == indirect_hl_operand) {
+            // Everything except BIT writes the result back to memory
+            if (!is_bit)
+                return false;
+
+            loop.reads_through_hl = true;
+            return true;
+        }
+
+        if (!is_bit)
+            written_registers |= get_register_bit(operand);
+        return true;
+    }
+
+    bool idle_loop_detector::reads_only_deterministic_pointers(const idle_loop& loop,
+                                                               const registers::register_file& registers) {
+        const auto& r = registers.whole;
+
+        return (!loop.reads_through_bc || is_deterministic_address(r.BC)) &&
+               (!loop.reads_through_de || is_deterministic_address(r.DE)) &&
+               (!loop.reads_through_hl || is_deterministic_address(r.HL)) &&
+               (!loop.reads_through_c || is_deterministic_address(io_start_address | registers.half.C));
+    }
+
+    std::size_t idle_loop_detector::get_skippable_machine_cycles(const idle_loop& loop,
+                                                                 const registers::register_file& registers,
+                                                                 std::size_t machine_cycle,
+                                                                 std::size_t machine_cycles_to_next_event,
+                                                                 std::size_t serviced_interrupts) {
+        // Flags might not have been written to F yet
+        registers::whole_registers r = registers.whole;
+        r.AF = registers.read_from_register(registers::whole_register_name::AF);
+        const auto& last = last_visit.registers;
+
+        // The last iteration started right where this one does, with the same registers, ran on its own without any
+        // interrupt, and ended before anything it reads could change. This one will do exactly the same.
+        bool repeats_last_iteration =
+            last_visit.key == last_key &&
+            last.AF == r.AF && last.BC == r.BC && last.DE == r.DE && last.HL == r.HL && last.SP == r.SP &&
+            last_visit.serviced_interrupts == serviced_interrupts &&
+            machine_cycle - last_visit.machine_cycle == loop.iteration_machine_cycles &&
+            loop.iteration_machine_cycles <= last_visit.machine_cycles_to_next_event &&
+            reads_only_deterministic_pointers(loop, registers);
+
+        std::size_t skipped = 0;
+        if (repeats_last_iteration) {
+            skipped = machine_cycles_to_next_event / loop.iteration_machine_cycles * loop.iteration_machine_cycles;
+
+            if (skipped > 0) {
+                ++fast_forwards;
+                fast_forwarded_machine_cycles += skipped;
+            }
+        }
+
+        // Skipped iterations leave everything as it was, so the next one compares against this one
+        last_visit = {last_key, r, machine_cycle + skipped, machine_cycles_to_next_event - skipped,
+                      serviced_interrupts};
+        return skipped;
+    }
+}
@@ -0,0 +1,153 @@
+// File: idle_loop_detector.hpp
+//
+// Created by Adrian Habusta on 17.10.2026
+//
+
+#ifndef SEMESTER_PROJECT_IDLE_LOOP_DETECTOR_HPP
+#define SEMESTER_PROJECT_IDLE_LOOP_DETECTOR_HPP
+
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+#include "../utility.hpp"
+#include "registers.hpp"
+#include "block_cache.hpp"
+
+namespace central_processing_unit {
+    // What can be told about a backward branch from the code alone
+    struct idle_loop {
+        // The body never writes, never leaves the loop other than through the branch, and only reads memory that
+        // changes on events
+        bool is_idle{false};
+        // Body and taken branch
+        unsigned iteration_machine_cycles{};
+
+        // Memory read through these registers, the loop itself never changes them
+        bool reads_through_bc{false};
+        bool reads_through_de{false};
+        bool reads_through_hl{false};
+        bool reads_through_c{false};
+    };
+
+    // Recognizes polling loops like LDH A,(LY) / CP n / JR NZ,e. Between two events nothing such a loop reads can
+    // change, so once one iteration ends with the same registers it started with, every iteration up to the next
+    // event does exactly the same thing, and the emulator can skip straight to it.
+    class idle_loop_detector {
+        static constexpr int max_instructions_per_loop = 16;
+
+        struct loop_visit {
+            dword key{};
+            registers::whole_registers registers{};
+            std::size_t machine_cycle{};
+            std::size_t machine_cycles_to_next_event{};
+            std::size_t serviced_interrupts{};
+        };
+
+        std::unordered_map<dword, idle_loop> loops;
+        dword last_key{};
+        const idle_loop* last_loop{nullptr};
+        loop_visit last_visit{};
+
+        static dword make_key(int bank, word branch_address) {
+            return (static_cast<dword>(bank) << 16) | branch_address;
+        }
+
+        // Returns false if the instruction can't be part of an idle loop
+        static bool add_instruction(idle_loop& loop, byte& written_registers, byte opcode, byte operand_low,
+                                    byte operand_high);
+        static bool add_cb_instruction(idle_loop& loop, byte& written_registers, byte cb_opcode);
+
+        [[nodiscard]] static bool reads_only_deterministic_pointers(const idle_loop& loop,
+                                                                    const registers::register_file& registers);
+
+    public:
+        std::uint64_t analyzed_loops{};
+        std::uint64_t idle_loops{};
+        std::uint64_t fast_forwards{};
+        std::uint64_t fast_forwarded_machine_cycles{};
+
+        // Everything except the timer's DIV and TIMA, VRAM, OAM and cartridge RAM only changes through CPU writes, or
+        // on events (LY, STAT, IF and the joypad)
+        [[nodiscard]] static bool is_deterministic_address(word address);
+
+        // The loop is [target_address, branch_address], read_rom must read without side effects and without cycling
+        template<typename rom_reader>
+        const idle_loop& find_or_analyze(int bank, word target_address, word branch_address, rom_reader&& read_rom) {
+            dword key = make_key(bank, branch_address);
+            if (last_loop != nullptr && last_key == key)
+                return *last_loop;
+
+            auto [it, inserted] = loops.try_emplace(key);
+            if (inserted) {
+                ++analyzed_loops;
+                it->second = analyze(bank, target_address, branch_address, read_rom);
+                if (it->second.is_idle)
+                    ++idle_loops;
+            }
+
+            last_key = key;
+            last_loop = &it->second;
+            return it->second;
+        }
+
+        // The next visit can't repeat one from before the state of the machine was replaced
+        void forget_last_visit() { last_visit = {}; }
+
+        // Called every time the CPU takes the branch of the loop last returned by find_or_analyze back to its start.
+        // Returns how many machine cycles can be skipped, always whole iterations that end before the next event.
+        std::size_t get_skippable_machine_cycles(const idle_loop& loop, const registers::register_file& registers,
+                                                 std::size_t machine_cycle, std::size_t machine_cycles_to_next_event,
+                                                 std::size_t serviced_interrupts);
+
+    private:
+        template<typename rom_reader>
+        static idle_loop analyze(int bank, word target_address, word branch_address, rom_reader&& read_rom) {
+            idle_loop loop{};
+
+            // The whole loop has to be in the same ROM bank
+            if (block_cache::get_region_end(target_address, bank) < branch_address)
+                return loop;
+
+            byte written_registers = 0;
+            word address = target_address;
+
+            for (int i = 0; i < max_instructions_per_loop && address < branch_address; ++i) {
+                byte opcode = read_rom(address);
+                byte length = block_cache::get_instruction_length(opcode);
+                byte operand_low = length > 1 ? read_rom(address + 1) : 0;
+                byte operand_high = length > 2 ? read_rom(address + 2) : 0;
+
+                if (!add_instruction(loop, written_registers, opcode, operand_low, operand_high))
+                    return loop;
+
+                loop.iteration_machine_cycles += block_cache::get_machine_cycles(opcode, operand_low);
+                address += length;
+            }
+
+            // Too long, or the last instruction overlaps the branch
+            if (address != branch_address)
+                return loop;
+
+            // JR or JP, the table doesn't include the extra cycle of the taken branch
+            loop.iteration_machine_cycles += block_cache::get_machine_cycles(read_rom(branch_address), 0) + 1;
+
+            // Pointers are only checked when the loop runs, so the loop can't change them
+            constexpr byte bc_registers = 0b000011;
+            constexpr byte de_registers = 0b001100;
+            constexpr byte hl_registers = 0b110000;
+            constexpr byte c_register = 0b000010;
+
+            if ((loop.reads_through_bc && (written_registers & bc_registers)) ||
+                (loop.reads_through_de && (written_registers & de_registers)) ||
+                (loop.reads_through_hl && (written_registers & hl_registers)) ||
+                (loop.reads_through_c && (written_registers & c_register)))
+                return loop;
+
+            loop.is_idle = true;
+            return loop;
+        }
+    };
+}
+
+#endif //SEMESTER_PROJECT_IDLE_LOOP_DETECTOR_HPP
@@ -0,0 +1,298 @@
+// File: jit_compiler.cpp
+//
+// Created by Adrian Habusta on 17.10.2026
+//
+
+#include <initializer_list>
+#include <cstddef>
+#include <cstring>
+#include <utility>
+
+#include "jit_compiler.hpp"
+
+#if defined(CPU_JIT_SUPPORTED)
+#include <sys/mman.h>
+#endif
+
+namespace central_processing_unit {
+    namespace {
+        constexpr std::size_t max_jit_instructions = 32;
+
+        // Offsets of the 8-bit registers in the register file, indexed like the register fields of the opcodes.
+        // Index 6 is (HL), which is never translated directly.
+        constexpr std::ptrdiff_t no_register = -1;
+        constexpr std::ptrdiff_t register_offsets[] = {
+            offsetof(registers::half_registers_correct_endian, B),
+            offsetof(registers::half_registers_correct_endian, C),
+            offsetof(registers::half_registers_correct_endian, D),
+            offsetof(registers::half_registers_correct_endian, E),
+            offsetof(registers::half_registers_correct_endian, H),
+            offsetof(registers::half_registers_correct_endian, L),
+            no_register,
+            offsetof(registers::half_registers_correct_endian, A),
+        };
+
+        constexpr int indirect_hl_operand = 6;
+
+        bool is_register_load(byte opcode) {
+            // LD r,r', without HALT and the (HL) variants
+            return (opcode & 0xC0) == 0x40 && opcode != 0x76 &&
+                   ((opcode >> 3) & 0x07) != indirect_hl_operand && (opcode & 0x07) != indirect_hl_operand;
+        }
+
+        bool is_immediate_load(byte opcode) {
+            // LD r,n, without LD (HL),n
+            return (opcode & 0xC7) == 0x06 && opcode != 0x36;
+        }
+
+        bool accesses_io(byte opcode) {
+            // LDH (n),A / LDH A,(n) / LD (C),A / LD A,(C)
+            return opcode == 0xE0 || opcode == 0xF0 || opcode == 0xE2 || opcode == 0xF2;
+        }
+
+        // Just the handful of x86-64 instructions the generated code needs. The generated function keeps the CPU in
+        // rbx, the register file in r12 and the decoded instructions in r13.
+        class x86_64_emitter {
+            std::vector<byte>& code;
+
+            void emit(std::initializer_list<byte> bytes) { code.insert(code.end(), bytes); }
+
+            void emit_dword(dword value) {
+                for (int i = 0; i < 4; ++i)
+                    code.push_back(static_cast<byte>(value >> (i * 8)));
+            }
+
+            void emit_qword(std::uint64_t value) {
+                for (int i = 0; i < 8; ++i)
+                    code.push_back(static_cast<byte>(value >> (i * 8)));
+            }
+
+        public:
+            explicit x86_64_emitter(std::vector<byte>& code) : code(code) {}
+
+            [[nodiscard]] std::size_t position() const { return code.size(); }
+
+            void prologue() {
+                // push rbx, push r12, push r13, this also aligns the stack for calls
+                emit({0x53, 0x41, 0x54, 0x41, 0x55});
+                // mov rbx, rdi / mov r12, rsi / mov r13, rdx
+                emit({0x48, 0x89, 0xFB, 0x49, 0x89, 0xF4, 0x49, 0x89, 0xD5});
+            }
+
+            void epilogue() {
+                // pop r13, pop r12, pop rbx, ret
+                emit({0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3});
+            }
+
+            void call(const void* function) {
+                // mov rdi, rbx
+                emit({0x48, 0x89, 0xDF});
+                // movabs rax, function / call rax
+                emit({0x48, 0xB8});
+                emit_qword(reinterpret_cast<std::uintptr_t>(function));
+                emit({0xFF, 0xD0});
+            }
+
+            void call_with_instruction(const void* function, std::size_t index) {
+                // lea rsi, [r13 + index * sizeof(decoded_instruction)]
+                emit({0x49, 0x8D, 0xB5});
+                emit_dword(static_cast<dword>(index * sizeof(decoded_instruction)));
+                call(function);
+            }
+
+            // Returns the position of the jump offset, so it can be patched once the target is known
+            std::size_t jump_if_false() {
+                // test al, al / jz rel32
+                emit({0x84, 0xC0, 0x0F, 0x84});
+                std::size_t patch_position = position();
+                emit_dword(0);
+                return patch_position;
+            }
+
+            // Same, for jumping when al holds the value
+            std::size_t jump_if_equal(byte value) {
+                // cmp al, value / je rel32
+                emit({0x3C, value, 0x0F, 0x84});
+                std::size_t patch_position = position();
+                emit_dword(0);
+                return patch_position;
+            }
+
+            std::size_t jump() {
+                // jmp rel32
+                emit({0xE9});
+                std::size_t patch_position = position();
+                emit_dword(0);
+                return patch_position;
+            }
+
+            void patch_jump(std::size_t patch_position, std::size_t target) {
+                auto offset = static_cast<dword>(target - (patch_position + 4));
+                std::memcpy(&code[patch_position], &offset, sizeof(offset));
+            }
+
+            void move_eax(dword value) {
+                // mov eax, value
+                emit({0xB8});
+                emit_dword(value);
+            }
+
+            void copy_register(std::ptrdiff_t target_offset, std::ptrdiff_t source_offset) {
+                // movzx eax, byte [r12 + source] / mov byte [r12 + target], al
+                emit({0x41, 0x0F, 0xB6, 0x44, 0x24, static_cast<byte>(source_offset)});
+                emit({0x41, 0x88, 0x44, 0x24, static_cast<byte>(target_offset)});
+            }
+
+            void store_register(std::ptrdiff_t target_offset, byte value) {
+                // mov byte [r12 + target], value
+                emit({0x41, 0xC6, 0x44, 0x24, static_cast<byte>(target_offset), value});
+            }
+        };
+    }
+
+#if defined(CPU_JIT_SUPPORTED)
+    executable_buffer::executable_buffer() {
+        void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapping != MAP_FAILED) {
+            memory = static_cast<byte*>(mapping);
+            mprotect(memory, size, PROT_READ | PROT_EXEC);
+        }
+    }
+
+    executable_buffer::~executable_buffer() {
+        if (memory != nullptr)
+            munmap(memory, size);
+    }
+
+    void* executable_buffer::append(const std::vector<byte>& code) {
+        if (memory == nullptr || used + code.size() > size)
+            return nullptr;
+
+        // The buffer is never writable and executable at the same time
+        if (mprotect(memory, size, PROT_READ | PROT_WRITE) != 0)
+            return nullptr;
+
+        byte* destination = memory + used;
+        std::memcpy(destination, code.data(), code.size());
+        used += code.size();
+
+        if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0)
+            return nullptr;
+
+        return destination;
+    }
+#else
+    executable_buffer::executable_buffer() = default;
+    executable_buffer::~executable_buffer() = default;
+
+    void* executable_buffer::append(const std::vector<byte>& code [[maybe_unused]]) { return nullptr; }
+#endif
+
+    bool jit_compiler::is_worth_compiling(const basic_block& block) {
+        const auto& instructions = block.instructions;
+        if (instructions.size() < 2 || instructions.size() > max_jit_instructions)
+            return false;
+
+        // Blocks that mostly talk to I/O registers spend their time in the memory map, and are usually polling
+        // loops that exit early anyway
+        std::size_t io_accesses = 0;
+        for (const auto& instruction : instructions) {
+            if (accesses_io(instruction.opcode))
+                ++io_accesses;
+        }
+
+        return io_accesses * 2 <= instructions.size();
+    }
+
+    std::vector<byte> jit_compiler::generate(const basic_block& block) const {
+        const auto& instructions = block.instructions;
+
+        std::vector<byte> code;
+        x86_64_emitter emitter(code);
+
+        // Jumps that leave the block before instruction i, i.e. after executing i instructions
+        std::vector<std::pair<std::size_t, std::size_t>> exits;
+
+        emitter.prologue();
+
+        std::size_t i = 0;
+        while (i < instructions.size()) {
+            const decoded_instruction& instruction = instructions[i];
+            byte opcode = instruction.opcode;
+
+            emitter.call_with_instruction(reinterpret_cast<const void*>(entry_points.is_at), i);
+            exits.emplace_back(emitter.jump_if_false(), i);
+
+            if (instruction.fused != fused_sequence::none) {
+                emitter.call_with_instruction(reinterpret_cast<const void*>(entry_points.execute_fused), i);
+
+                // It returns how many of its instructions were executed, fewer than all of them after an interrupt
+                int length = get_fused_length(instruction.fused);
+                for (int executed = 1; executed < length; ++executed)
+                    exits.emplace_back(emitter.jump_if_equal(static_cast<byte>(executed)), i + executed);
+
+                i += length;
+                continue;
+            }
+
+            if (is_register_load(opcode)) {
+                emitter.copy_register(register_offsets[(opcode >> 3) & 0x07], register_offsets[opcode & 0x07]);
+            }
+            else if (is_immediate_load(opcode)) {
+                // The value was read while decoding, but the fetch cycle still has to happen
+                emitter.call(reinterpret_cast<const void*>(entry_points.skip_immediate));
+                emitter.store_register(register_offsets[(opcode >> 3) & 0x07],
+                                       utility::get_low_byte(instruction.immediate));
+            }
+            else {
+                emitter.call(reinterpret_cast<const void*>(entry_points.instructions[opcode]));
+
+                ++i;
+                continue;
+            }
+
+            emitter.call(reinterpret_cast<const void*>(entry_points.prefetch));
+
+            ++i;
+        }
+
+        exits.emplace_back(emitter.jump(), instructions.size());
+
+        // One small exit stub for each distinct count, all of them sharing the epilogue
+        std::vector<std::size_t> exit_stubs(instructions.size() + 1);
+        std::vector<std::size_t> epilogue_jumps;
+        for (std::size_t count = 0; count <= instructions.size(); ++count) {
+            exit_stubs[count] = emitter.position();
+            emitter.move_eax(static_cast<dword>(count));
+            epilogue_jumps.push_back(emitter.jump());
+        }
+
+        std::size_t epilogue_position = emitter.position();
+        emitter.epilogue();
+
+        for (auto [patch_position, count] : exits)
+            emitter.patch_jump(patch_position, exit_stubs[count]);
+        for (std::size_t patch_position : epilogue_jumps)
+            emitter.patch_jump(patch_position, epilogue_position);
+
+        return code;
+    }
+
+    void jit_compiler::compile(basic_block& block) {
+        if (!is_worth_compiling(block)) {
+            block.jit_rejected = true;
+            ++rejected_blocks;
+            return;
+        }
+
+        void* function = buffer.append(generate(block));
+        if (function == nullptr) {
+            block.jit_rejected = true;
+            ++rejected_blocks;
+            return;
+        }
+
+        block.compiled = reinterpret_cast<jit_function>(function);
+        ++compiled_blocks;
+    }
+}
@@ -0,0 +1,80 @@
+// File: jit_compiler.hpp
+//
+// Created by Adrian Habusta on 17.10.2026
+//
+
+#ifndef SEMESTER_PROJECT_JIT_COMPILER_HPP
+#define SEMESTER_PROJECT_JIT_COMPILER_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <vector>
+
+#include "../utility.hpp"
+#include "block_cache.hpp"
+
+// Only x86-64 with the System V calling convention is supported, everywhere else the JIT never compiles anything
+#if defined(__x86_64__) && defined(__unix__)
+#define CPU_JIT_SUPPORTED
+#endif
+
+namespace central_processing_unit {
+    // Functions the generated code calls back into. Every memory access still goes through the CPU, so the bus runs
+    // exactly the same machine cycles as in the interpreter. Only the results of is_at and execute_fused decide whether
+    // the generated code leaves the block, none of them throw, as exceptions can't unwind through the generated code.
+    struct jit_entry_points {
+        using instruction_handler = void (*)(cpu* self);
+
+        bool (*is_at)(cpu* self, const decoded_instruction* instruction);
+        void (*prefetch)(cpu* self);
+        void (*skip_immediate)(cpu* self);
+        // Returns how many instructions of the sequence were executed
+        int (*execute_fused)(cpu* self, const decoded_instruction* instruction);
+        std::array<instruction_handler, 256> instructions;
+    };
+
+    // Executable memory, mapped writable while code is emitted and executable otherwise
+    class executable_buffer {
+        byte* memory{nullptr};
+        std::size_t used{};
+
+    public:
+        static constexpr std::size_t size = 8 * 1024 * 1024;
+
+        executable_buffer();
+        ~executable_buffer();
+
+        executable_buffer(const executable_buffer&) = delete;
+        executable_buffer& operator=(const executable_buffer&) = delete;
+
+        // Returns the address of the copied code, nullptr if the buffer is full
+        void* append(const std::vector<byte>& code);
+    };
+
+    // Translates hot basic blocks into x86-64. Register to register loads and immediate loads are translated
+    // directly, the rest calls the per-opcode handlers of the interpreter. Before every instruction the generated code
+    // checks that the CPU is still where the block expects it to be, and leaves the block otherwise.
+    class jit_compiler {
+        const jit_entry_points& entry_points;
+        executable_buffer buffer;
+
+        static bool is_worth_compiling(const basic_block& block);
+        [[nodiscard]] std::vector<byte> generate(const basic_block& block) const;
+
+    public:
+        // Blocks are interpreted this many times before they get compiled
+        static constexpr std::uint32_t compile_threshold = 16;
+
+        std::uint64_t compiled_blocks{};
+        std::uint64_t rejected_blocks{};
+        std::uint64_t compiled_executions{};
+
+        explicit jit_compiler(const jit_entry_points& entry_points) : entry_points(entry_points) {}
+
+        // Sets block.compiled, or block.jit_rejected if the block isn't worth it or can't be compiled
+        void compile(basic_block& block);
+    };
+}
+
+#endif //SEMESTER_PROJECT_JIT_COMPILER_HPP
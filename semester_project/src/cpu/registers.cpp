@@ -9,7 +9,7 @@ namespace registers {
     void register_file::write_to_register(half_register_name target_register, byte value) {
         switch (target_register) {
             case half_register_name::A: half.A = value; break;
-            case half_register_name::F: half.F = value; break;
+            case half_register_name::F: write_flags_from_register(value); break;
             case half_register_name::B: half.B = value; break;
             case half_register_name::C: half.C = value; break;
             case half_register_name::D: half.D = value; break;
@@ -21,7 +21,10 @@ namespace registers {
     }
     void register_file::write_to_register(whole_register_name target_register, word value) {
         switch (target_register) {
-            case whole_register_name::AF: whole.AF = value & AF_mask; break;
+            case whole_register_name::AF:
+                half.A = utility::get_high_byte(value);
+                write_flags_from_register(utility::get_low_byte(value & AF_mask));
+                break;
             case whole_register_name::BC: whole.BC = value; break;
             case whole_register_name::DE: whole.DE = value; break;
             case whole_register_name::HL: whole.HL = value; break;
@@ -34,7 +37,7 @@ namespace registers {
     byte register_file::read_from_register(half_register_name target_register) const {
         switch (target_register) {
             case half_register_name::A: return half.A;
-            case half_register_name::F: return half.F;
+            case half_register_name::F: return read_flags();
             case half_register_name::B: return half.B;
             case half_register_name::C: return half.C;
             case half_register_name::D: return half.D;
@@ -47,7 +50,7 @@ namespace registers {
 
     word register_file::read_from_register(whole_register_name target_register) const {
         switch (target_register) {
-            case whole_register_name::AF: return whole.AF & AF_mask;
+            case whole_register_name::AF: return utility::get_word_from_bytes(read_flags(), half.A) & AF_mask;
             case whole_register_name::BC: return whole.BC;
             case whole_register_name::DE: return whole.DE;
             case whole_register_name::HL: return whole.HL;
@@ -49,19 +49,117 @@ namespace registers {
     using half_registers_correct_endian = std::conditional_t<is_little_endian, half_registers_little_endian,
             half_registers_big_endian>;
 
-    union register_file {
-        whole_registers whole{};
-        half_registers_correct_endian half;
+    // 8-bit operands as the opcodes encode them, in bits 0-2 or 3-5. 6 is (HL), which isn't a register.
+    constexpr int indirect_hl_operand = 6;
+    constexpr byte half_registers_correct_endian::* operand_registers[] = {
+        &half_registers_correct_endian::B, &half_registers_correct_endian::C,
+        &half_registers_correct_endian::D, &half_registers_correct_endian::E,
+        &half_registers_correct_endian::H, &half_registers_correct_endian::L,
+        nullptr, &half_registers_correct_endian::A
+    };
 
-        void write_zero_flag(bool value) { half.F = utility::write_bit(half.F, zero_flag_pos, value); }
-        void write_subtract_flag(bool value) { half.F = utility::write_bit(half.F, subtract_flag_pos, value); }
-        void write_half_carry_flag(bool value) { half.F = utility::write_bit(half.F, half_carry_flag_pos, value); }
-        void write_carry_flag(bool value) { half.F = utility::write_bit(half.F, carry_flag_pos, value); }
+    // Operations whose flags can be computed later from their operands and result, see register_file
+    enum class flag_operation : byte {
+        // Z from the result, N and H cleared, C given
+        bitwise,
+        // Same, but H set
+        and_,
+        // Z from the result, N, H and C computed from the operands
+        add,
+        subtract,
+        // Z from the result, N and H computed from the operand, C given
+        increment,
+        decrement,
+    };
 
-        [[nodiscard]] bool read_zero_flag() const { return utility::get_bit(half.F, zero_flag_pos); }
-        [[nodiscard]] bool read_subtract_flag() const { return utility::get_bit(half.F, subtract_flag_pos); }
-        [[nodiscard]] bool read_half_carry_flag() const { return utility::get_bit(half.F, half_carry_flag_pos); }
-        [[nodiscard]] bool read_carry_flag() const { return utility::get_bit(half.F, carry_flag_pos); }
+    // With CPU_LAZY_FLAGS, the register file only records the operands and result of the last flag_operation, and Z,
+    // N, H and C are computed when something reads them. Most flags get overwritten before anyone looks at them.
+    struct register_file {
+        union {
+            whole_registers whole{};
+            half_registers_correct_endian half;
+        };
+
+        // Sets all four flags at once
+        void write_flags(bool zero, bool subtract, bool half_carry, bool carry) {
+            half.F = zero << zero_flag_pos | subtract << subtract_flag_pos | half_carry << half_carry_flag_pos |
+                     carry << carry_flag_pos;
+#if defined(CPU_LAZY_FLAGS)
+            has_pending_flags = false;
+#endif
+        }
+
+        // Sets all four flags as the operation would, carry is the carry in for add and subtract
+        void write_flags_from_operation(flag_operation operation, byte left, byte right, bool carry, byte result) {
+#if defined(CPU_LAZY_FLAGS)
+            pending_operation = operation;
+            pending_left = left;
+            pending_right = right;
+            pending_carry = carry;
+            pending_result = result;
+            has_pending_flags = true;
+#else
+            write_flags(result == 0, is_subtraction(operation), get_half_carry(operation, left, right, carry),
+                        get_carry(operation, left, right, carry));
+#endif
+        }
+
+        void write_zero_flag(bool value) {
+            materialize_flags();
+            half.F = utility::write_bit(half.F, zero_flag_pos, value);
+        }
+        void write_subtract_flag(bool value) {
+            materialize_flags();
+            half.F = utility::write_bit(half.F, subtract_flag_pos, value);
+        }
+        void write_half_carry_flag(bool value) {
+            materialize_flags();
+            half.F = utility::write_bit(half.F, half_carry_flag_pos, value);
+        }
+        void write_carry_flag(bool value) {
+            materialize_flags();
+            half.F = utility::write_bit(half.F, carry_flag_pos, value);
+        }
+
+        [[nodiscard]] bool read_zero_flag() const {
+#if defined(CPU_LAZY_FLAGS)
+            if (has_pending_flags)
+                return pending_result == 0;
+#endif
+            return utility::get_bit(half.F, zero_flag_pos);
+        }
+        [[nodiscard]] bool read_subtract_flag() const {
+#if defined(CPU_LAZY_FLAGS)
+            if (has_pending_flags)
+                return is_subtraction(pending_operation);
+#endif
+            return utility::get_bit(half.F, subtract_flag_pos);
+        }
+        [[nodiscard]] bool read_half_carry_flag() const {
+#if defined(CPU_LAZY_FLAGS)
+            if (has_pending_flags)
+                return get_half_carry(pending_operation, pending_left, pending_right, pending_carry);
+#endif
+            return utility::get_bit(half.F, half_carry_flag_pos);
+        }
+        [[nodiscard]] bool read_carry_flag() const {
+#if defined(CPU_LAZY_FLAGS)
+            if (has_pending_flags)
+                return get_carry(pending_operation, pending_left, pending_right, pending_carry);
+#endif
+            return utility::get_bit(half.F, carry_flag_pos);
+        }
+
+        // F as the CPU sees it, whole.AF and half.F can be stale with CPU_LAZY_FLAGS
+        [[nodiscard]] byte read_flags() const {
+#if defined(CPU_LAZY_FLAGS)
+            if (has_pending_flags) {
+                return read_zero_flag() << zero_flag_pos | read_subtract_flag() << subtract_flag_pos |
+                       read_half_carry_flag() << half_carry_flag_pos | read_carry_flag() << carry_flag_pos;
+            }
+#endif
+            return half.F;
+        }
 
         void write_to_register(half_register_name register_name, byte value);
         void write_to_register(whole_register_name  register_name, word value);
@@ -76,6 +174,54 @@ namespace registers {
             half_carry_flag_pos = 5,
             carry_flag_pos = 4
         };
+
+#if defined(CPU_LAZY_FLAGS)
+        flag_operation pending_operation{};
+        byte pending_left{};
+        byte pending_right{};
+        byte pending_result{};
+        bool pending_carry{};
+        bool has_pending_flags{false};
+#endif
+
+        void write_flags_from_register(byte value) {
+            half.F = value;
+#if defined(CPU_LAZY_FLAGS)
+            has_pending_flags = false;
+#endif
+        }
+
+        void materialize_flags() {
+#if defined(CPU_LAZY_FLAGS)
+            if (has_pending_flags) {
+                half.F = read_flags();
+                has_pending_flags = false;
+            }
+#endif
+        }
+
+        static constexpr bool is_subtraction(flag_operation operation) {
+            return operation == flag_operation::subtract || operation == flag_operation::decrement;
+        }
+
+        static constexpr bool get_half_carry(flag_operation operation, byte left, byte right, bool carry) {
+            switch (operation) {
+                case flag_operation::add: return (left & 0xF) + (right & 0xF) + carry > 0xF;
+                case flag_operation::subtract: return (left & 0xF) < (right & 0xF) + carry;
+                case flag_operation::increment: return (left & 0xF) == 0xF;
+                case flag_operation::decrement: return (left & 0xF) == 0x0;
+                case flag_operation::and_: return true;
+                default: return false;
+            }
+        }
+
+        static constexpr bool get_carry(flag_operation operation, byte left, byte right, bool carry) {
+            switch (operation) {
+                case flag_operation::add: return left + right + carry > 0xFF;
+                case flag_operation::subtract: return left < right + carry;
+                default: return carry;
+            }
+        }
     };
 }
 
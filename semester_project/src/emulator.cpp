@@ -4,8 +4,13 @@
 //
 
 #include <string_view>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
 #include <chrono>
+#include <string>
 #include <thread>
+#include <array>
 
 #include "cpu/central_processing_unit.hpp"
 #include "hardware/cartridge.hpp"
@@ -16,37 +21,24 @@
 #include "utility.hpp"
 
 namespace emulator {
+    namespace {
+        constexpr std::uint32_t state_magic = 0x54534247; // "GBST" in little endian
 
-    byte emulator::read_with_cycling(word address) {
-        byte value = memory.read_from_address(address);
-        run_machine_cycle();
-        return value;
-    }
-    void emulator::write_with_cycling(word address, byte value) {
-        run_machine_cycle();
-        memory.write_to_address(address, value);
-    }
-
-    void emulator::memory_map::write_to_address(word address, byte value) {
-        if (is_dma_active() && address < hram_start_address)
-            return;
-
-        write_memory(address, value);
-    }
-
-    byte emulator::memory_map::read_from_address(word address) {
-        if (is_dma_active() && address < hram_start_address)
-            return utility::undefined_byte;
-
-        return read_memory(address);
+        struct state_header {
+            std::uint32_t magic;
+            std::uint32_t version;
+            std::uint64_t size;
+        };
     }
 
     void emulator::memory_map::write_memory(word address, byte value) {
         if (address <= rom_end_address) {
             emu_ref.cart.write_rom(address - rom_start_address, value);
+            map_rom_pages();
         }
         else if (address <= vram_end_address) {
             emu_ref.ppu.write_vram(address - vram_start_address, value);
+            dirty_pages[address >> page_bits] = true;
         }
         else if (address <= sram_end_address) {
             emu_ref.cart.write_ram(address - sram_start_address, value);
@@ -110,19 +102,105 @@ namespace emulator {
         return utility::undefined_byte;
     }
 
-    emulator::emulator(SDL_Renderer* renderer, std::string_view boot_rom_path, std::string_view rom_path,
-                       std::string_view sram_path)
-        : cpu([this](word addr){ return read_with_cycling(addr); },
-              [this](word addr, byte value){ write_with_cycling(addr, value); },
-              [this](){ run_machine_cycle(); }),
-          emulated_timer([this]{ cpu.request_timer_interrupt(); }),
-          ppu(renderer, [this]{ cpu.request_lcd_stat_interrupt(); },
-                        [this]{ cpu.request_v_blank_interrupt(); } ),
-          buttons([this]{ cpu.request_joypad_interrupt(); } ),
+    void emulator::memory_map::map_pages() {
+        // Echo RAM repeats WRAM
+        for (int page = wram_start_address >> page_bits; page <= echo_end_address >> page_bits; ++page) {
+            word offset = ((page << page_bits) - wram_start_address) & (wram_end_address - wram_start_address);
+            read_pages[page] = write_pages[page] = emu_ref.ram.get_wram_data(offset);
+        }
+
+        map_rom_pages();
+        map_vram_pages(emu_ref.ppu.is_vram_blocked());
+    }
+
+    void emulator::memory_map::map_rom_pages() {
+        for (int page = rom_start_address >> page_bits; page <= rom_end_address >> page_bits; ++page)
+            read_pages[page] = emu_ref.cart.get_rom_data(page << page_bits);
+    }
+
+    void emulator::memory_map::map_vram_pages(bool is_blocked) {
+        for (int page = vram_start_address >> page_bits; page <= vram_end_address >> page_bits; ++page) {
+            byte* data = is_blocked ? nullptr : emu_ref.ppu.get_vram_data((page << page_bits) - vram_start_address);
+            read_pages[page] = data;
+            // Writes to tile data go through the PPU, so that it can decode the tile again
+            write_pages[page] = page > tile_data_end_address >> page_bits ? data : nullptr;
+        }
+
+        is_vram_unmapped = is_blocked;
+    }
+
+    bool emulator::memory_map::is_any_page_dirty(word start_address, word end_address) const {
+        for (int page = start_address >> page_bits; page <= end_address >> page_bits; ++page) {
+            if (dirty_pages[page])
+                return true;
+        }
+
+        return false;
+    }
+
+    bool emulator::memory_map::is_wram_dirty(std::size_t offset, std::size_t size) const {
+        word start = wram_start_address + offset;
+        word end = start + size - 1;
+
+        // The last pages of WRAM don't have an echo
+        word echo_end = std::min<word>(end + (echo_start_address - wram_start_address), echo_end_address);
+        return is_any_page_dirty(start, end) || is_any_page_dirty(start + (echo_start_address - wram_start_address),
+                                                                   echo_end);
+    }
+
+    bool emulator::memory_map::is_vram_dirty(std::size_t offset, std::size_t size) const {
+        word start = vram_start_address + offset;
+        return is_any_page_dirty(start, start + size - 1);
+    }
+
+    const byte* emulator::memory_map::get_dma_source_data(word address) {
+        if (address < vram_start_address)
+            return nullptr;
+        if (address <= vram_end_address)
+            return emu_ref.ppu.get_vram_data(address - vram_start_address);
+        if (address <= sram_end_address)
+            return nullptr;
+        if (address <= wram_end_address)
+            return emu_ref.ram.get_wram_data(address - wram_start_address);
+
+        // DMA doesn't see OAM or the IO registers, everything above WRAM is an echo of it
+        return emu_ref.ram.get_wram_data(address - echo_start_address);
+    }
+
+    void emulator::memory_map::start_dma(byte upper_address_byte) {
+        word source_address = utility::get_word_from_bytes(0, upper_address_byte);
+        const byte* source = get_dma_source_data(source_address);
+
+        // The cartridge is only accessible through the MBC. Writes to it are blocked until the end of the transfer,
+        // so it reads the same now as it would during the transfer.
+        std::array<byte, dma_bytes_copied_amount> cartridge_data;
+        if (source == nullptr) {
+            for (word i = 0; i < dma_bytes_copied_amount; ++i) {
+                word address = source_address + i;
+                cartridge_data[i] = address <= rom_end_address ? emu_ref.cart.read_rom(address - rom_start_address)
+                                                               : emu_ref.cart.read_ram(address - sram_start_address);
+            }
+            source = cartridge_data.data();
+        }
+
+        emu_ref.ppu.write_oam_dma(source);
+        dma_end_cycle = emu_ref.get_total_machine_cycles() + dma_machine_cycles;
+    }
+
+    emulator::emulator(frontend::frame_sink& frames, frontend::input_source& input, std::string_view boot_rom_path,
+                       std::string_view rom_path, std::string_view sram_path)
+        : bus(*this),
+          cpu(bus),
+          emulated_timer({cpu.interrupt_requested_register, central_processing_unit::interrupt_type::timer}),
+          ppu(frames, {cpu.interrupt_requested_register, central_processing_unit::interrupt_type::lcd_stat},
+                        {cpu.interrupt_requested_register, central_processing_unit::interrupt_type::vblank}),
+          buttons({cpu.interrupt_requested_register, central_processing_unit::interrupt_type::joypad}),
           apu(),
           cart(boot_rom_path, rom_path, sram_path),
           ram(),
-          memory(*this) {
+          memory(*this),
+          input(input) {
+        schedule_next_event();
     }
 
     void emulator::sleep_if_frame_time_too_short(time_point time) {
@@ -133,63 +211,237 @@ namespace emulator {
         }
     }
 
-    void emulator::run_machine_cycle() {
-        memory.perform_dma_cycle();
-        ppu.run_machine_cycle();
-        //apu.run_machine_cycle();
-        emulated_timer.run_machine_cycle();
+    void emulator::sync_components() {
+        sync_ppu();
+        emulated_timer.run_until(get_total_machine_cycles());
+    }
+
+    void emulator::handle_cycle_limit() {
+        if (cycle_counter >= next_event_cycle) {
+            sync_components();
+            schedule_next_event();
+        }
+
+        if (cycle_counter >= m_cycles_per_frame)
+            end_frame();
+
+        if (get_total_machine_cycles() >= run_deadline)
+            finish_run(run_result::cycles_elapsed);
+
+        update_cycle_limit();
+    }
+
+    void emulator::end_frame() {
+        bool quit_requested = buttons.handle_input(input);
+
+        sync_components();
+        cycle_counter = 0;
+        ppu_synced_cycle = 0;
+        frame_counter++;
+        schedule_next_event();
+
+        if (quit_requested)
+            finish_run(run_result::quit_requested);
+        else if (return_on_frame_end)
+            finish_run(run_result::frame_complete);
+
+        limit_frame_rate();
+    }
+
+    void emulator::limit_frame_rate() {
+        if (!frame_rate_limited)
+            return;
+
+        auto time = clock::now();
+        sleep_if_frame_time_too_short(time);
+        last_frame_time_point = time;
+    }
+
+    void emulator::poll_input_while_stopped() {
+        emulated_timer.write_divider(get_total_machine_cycles());
+        schedule_next_event();
 
-        cycle_counter++;
+        auto time = clock::now();
 
-        if (cycle_counter >= m_cycles_per_frame) {
-            buttons.handle_input();
+        while (auto event = input.poll_event()) {
+            if (event->event_type == frontend::input_event::type::quit) {
+                finish_run(run_result::quit_requested);
+                return;
+            }
 
-            cycle_counter = 0;
+            if (event->event_type == frontend::input_event::type::button_pressed) {
+                cpu.wake_up_from_stop();
+                break;
+            }
+        }
 
-            auto time = clock::now();
+        if (frame_rate_limited) {
             sleep_if_frame_time_too_short(time);
             last_frame_time_point = time;
         }
+
+        if (!cpu.is_stopped() && buttons.handle_input(input))
+            finish_run(run_result::quit_requested);
     }
 
-    bool check_if_pressed_key_is_emulator_key(SDL_Keycode key) {
-        switch (key) {
-            case SDLK_UP:
-            case SDLK_DOWN:
-            case SDLK_LEFT:
-            case SDLK_RIGHT:
-            case SDLK_z:
-            case SDLK_x:
-            case SDLK_RETURN:
-            case SDLK_SPACE:
-                return true;
+    bool emulator::is_at_breakpoint() const {
+        return cpu.is_running() &&
+               std::find(breakpoints.begin(), breakpoints.end(), cpu.get_next_instruction_address()) !=
+               breakpoints.end();
+    }
 
-            default:
-                return false;
+    run_result emulator::run(std::size_t machine_cycles, bool until_frame_end) {
+        if (machine_cycles == 0)
+            return run_result::cycles_elapsed;
+
+        pending_result.reset();
+        return_on_frame_end = until_frame_end;
+        run_deadline = machine_cycles == no_deadline ? no_deadline : get_total_machine_cycles() + machine_cycles;
+        update_cycle_limit();
+
+        // The run that stopped at a breakpoint has to be able to continue past it
+        bool is_first_instruction = true;
+
+        while (!pending_result) {
+            if (cpu.is_stopped()) {
+                poll_input_while_stopped();
+                if (cpu.is_stopped())
+                    finish_run(run_result::stop);
+            }
+            else if (breakpoints.empty()) {
+                cpu.execute();
+            }
+            else if (!is_first_instruction && is_at_breakpoint()) {
+                finish_run(run_result::breakpoint);
+            }
+            else {
+                cpu.step_instruction();
+                is_first_instruction = false;
+            }
         }
+
+        return_on_frame_end = false;
+        run_deadline = no_deadline;
+        update_cycle_limit();
+
+        return *pending_result;
+    }
+
+    void emulator::restore_derived_state() {
+        cpu.forget_history();
+        cart.invalidate_rom_mapping();
+        memory.map_pages();
+        memory.mark_all_pages_dirty();
+        ppu.invalidate_caches();
+        schedule_next_event();
+    }
+
+    std::size_t emulator::get_state_size() {
+        std::size_t size = sizeof(state_header);
+        auto add_size = [&](std::span<byte> part) { size += part.size(); };
+        visit_state(add_size);
+        return size;
+    }
+
+    std::size_t emulator::save_state(std::span<byte> buffer) {
+        std::size_t size = get_state_size();
+        if (buffer.size() < size)
+            throw std::runtime_error("Save state buffer too small, " + std::to_string(size) + " bytes needed");
+
+        state_header header{state_magic, state_format_version, size};
+        std::memcpy(buffer.data(), &header, sizeof(header));
+
+        std::size_t offset = sizeof(header);
+        auto write_part = [&](std::span<byte> part) {
+            std::memcpy(buffer.data() + offset, part.data(), part.size());
+            offset += part.size();
+        };
+        visit_state(write_part);
+
+        return offset;
     }
 
-    void emulator::stop_loop() {
-        // FIXME: this is ugly
-        bool stopped = true;
-        while (stopped) {
-            auto time = clock::now();
+    void emulator::load_state(std::span<const byte> buffer) {
+        state_header header{};
+        if (buffer.size() >= sizeof(header))
+            std::memcpy(&header, buffer.data(), sizeof(header));
 
-            SDL_Event event;
-            while (SDL_PollEvent(&event)) {
-                if (event.type == SDL_QUIT)
-                    throw exit();
+        if (header.magic != state_magic)
+            throw std::runtime_error("Not a save state");
+        if (header.version != state_format_version)
+            throw std::runtime_error("Save state version " + std::to_string(header.version) + " is not supported");
+        if (header.size != get_state_size() || buffer.size() < header.size)
+            throw std::runtime_error("Save state is for a different cartridge, or truncated");
 
-                if (event.type == SDL_KEYDOWN) {
-                    stopped = !check_if_pressed_key_is_emulator_key(event.key.keysym.sym);
-                    if (!stopped)
-                        break;
-                }
+        std::size_t offset = sizeof(header);
+        auto read_part = [&](std::span<byte> part) {
+            std::memcpy(part.data(), buffer.data() + offset, part.size());
+            offset += part.size();
+        };
+        visit_state(read_part);
+
+        restore_derived_state();
+    }
+
+    void emulator::collect_dirty_state_pages(std::span<byte> dirty) {
+        // Where WRAM and VRAM are in the save state
+        std::span<byte> wram, vram;
+        std::size_t wram_offset = 0, vram_offset = 0;
+        std::size_t offset = sizeof(state_header);
+
+        auto find_memory = [&](std::span<byte> part) {
+            if (part.data() == ram.get_wram_data(0)) {
+                wram = part;
+                wram_offset = offset;
+            }
+            else if (part.data() == ppu.get_vram_data(0)) {
+                vram = part;
+                vram_offset = offset;
             }
+            offset += part.size();
+        };
+        visit_state(find_memory);
 
-            sleep_if_frame_time_too_short(time);
-            last_frame_time_point = time;
+        // Pages that hold only WRAM or only VRAM
+        auto is_inside = [](std::size_t start, std::size_t end, std::size_t part_offset, std::span<byte> part) {
+            return start >= part_offset && end <= part_offset + part.size();
+        };
+
+        for (std::size_t page = 0; page < dirty.size(); ++page) {
+            std::size_t start = page * state_page_size;
+            std::size_t end = start + state_page_size;
+
+            bool is_dirty = true;
+            if (is_inside(start, end, wram_offset, wram))
+                is_dirty = memory.is_wram_dirty(start - wram_offset, state_page_size);
+            else if (is_inside(start, end, vram_offset, vram))
+                is_dirty = memory.is_vram_dirty(start - vram_offset, state_page_size);
+
+            if (is_dirty)
+                dirty[page] = 1;
         }
-        buttons.handle_input();
+
+        memory.clear_dirty_pages();
+    }
+
+    void emulator::present_current_frame() {
+        ppu.present_current_frame();
+        limit_frame_rate();
+    }
+
+    run_result emulator::step_cpu() {
+        pending_result.reset();
+        return_on_frame_end = true;
+
+        if (cpu.is_stopped())
+            poll_input_while_stopped();
+        else
+            cpu.step();
+
+        return_on_frame_end = false;
+
+        if (pending_result)
+            return *pending_result;
+        return cpu.is_stopped() ? run_result::stop : run_result::cycles_elapsed;
     }
-}
\ No newline at end of file
+}
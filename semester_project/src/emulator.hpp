@@ -7,9 +7,14 @@
 #define SEMESTER_PROJECT_EMULATOR_HPP
 
 #include <string_view>
-#include <functional>
+#include <algorithm>
+#include <optional>
+#include <limits>
 #include <chrono>
+#include <cstdint>
+#include <vector>
 #include <array>
+#include <span>
 
 #include "cpu/central_processing_unit.hpp"
 #include "hardware/cartridge.hpp"
@@ -19,13 +24,22 @@
 #include "hardware/ram.hpp"
 #include "hardware/ppu.hpp"
 
+#include "frontend/input_source.hpp"
+#include "frontend/frame_sink.hpp"
+#include "machine_state.hpp"
 #include "utility.hpp"
 
 
 namespace emulator {
-    // Used as exception by the STOP instruction
-    class stop {};
-    class exit {};
+    // Why one of the run methods returned
+    enum class run_result {
+        frame_complete,
+        cycles_elapsed,
+        // The CPU executed STOP, and stays stopped until one of the emulator's keys is pressed
+        stop,
+        quit_requested,
+        breakpoint
+    };
 
     constexpr std::size_t t_cycles_per_m_cycle = 4;
 
@@ -36,32 +50,95 @@ namespace emulator {
     constexpr double frame_frequency = (double)m_cycle_frequency / m_cycles_per_frame; //59.7Hz
     constexpr double ns_per_frame = 1000000000 / frame_frequency;
 
+    class emulator;
+
+    // The CPU's view of the rest of the system. Everything is defined inline below, so the CPU instructions compile
+    // into direct calls into the memory map and components.
+    class cpu_bus {
+        emulator& emu_ref;
+
+    public:
+        explicit cpu_bus(emulator& emulator) : emu_ref(emulator) {}
+
+        byte read_memory(word address);
+        void write_memory(word address, byte value);
+        void run_phantom_cycle();
+        // Runs all components up to the next cycle in which one of them could request an interrupt
+        void run_until_next_event();
+        // Same, but only for the given number of cycles, which must not be more than there are until the next event
+        void fast_forward(std::size_t machine_cycles);
+        [[nodiscard]] std::size_t get_machine_cycles_to_next_event();
+        [[nodiscard]] std::size_t get_machine_cycle_count();
+
+        // Used by the block cache, these don't take any cycles
+        byte peek_rom(word address);
+        int get_rom_bank(word address);
+        dword get_rom_mapping_generation();
+        bool is_dma_active();
+    };
+
     class emulator {
+        friend class cpu_bus;
+
         class memory_map {
         public:
-            explicit memory_map(emulator& emulator) : emu_ref(emulator) {}
+            explicit memory_map(emulator& emulator) : emu_ref(emulator) { map_pages(); }
+
+            byte read_from_address(word address) {
+                if (is_dma_active() && address < hram_start_address)
+                    return utility::undefined_byte;
 
-            byte read_from_address(word address);
-            void write_to_address(word address, byte value);
+                const byte* page = read_pages[address >> page_bits];
+                if (page != nullptr)
+                    return page[address & page_offset_mask];
 
-            void perform_dma_cycle() {
-                for (unsigned i = 0; i < t_cycles_per_m_cycle; ++i) {
-                    if (dma_bytes_left > 0) {
-                        --dma_bytes_left;
+                return read_memory(address);
+            }
 
-                        byte dest_oam_addr = dma_bytes_copied_amount - dma_bytes_left - 1;
+            void write_to_address(word address, byte value) {
+                if (is_dma_active() && address < hram_start_address)
+                    return;
 
-                        byte value = read_memory(dma_source_address + dest_oam_addr);
-                        emu_ref.ppu.write_oam_dma(dest_oam_addr, value);
-                    }
+                byte* page = write_pages[address >> page_bits];
+                if (page != nullptr) {
+                    page[address & page_offset_mask] = value;
+                    dirty_pages[address >> page_bits] = true;
+                    return;
                 }
+
+                write_memory(address, value);
+            }
+
+            template<typename visitor> void visit_state(visitor& visit) {
+                machine_state::visit_members(visit, dma_end_cycle);
             }
+
+            // Maps everything again, after the state of the components was changed from outside
+            void map_pages();
+
+            // WRAM and VRAM are only written through here, the pages written since the last clear are dirty. Offsets
+            // are from the start of WRAM and VRAM.
+            [[nodiscard]] bool is_wram_dirty(std::size_t offset, std::size_t size) const;
+            [[nodiscard]] bool is_vram_dirty(std::size_t offset, std::size_t size) const;
+            void clear_dirty_pages() { dirty_pages.fill(false); }
+            void mark_all_pages_dirty() { dirty_pages.fill(true); }
+
+            // Has to be called whenever the PPU could have entered or left pixel transfer
+            void update_vram_pages() {
+                bool is_blocked = emu_ref.ppu.is_vram_blocked();
+                if (is_blocked != is_vram_unmapped)
+                    map_vram_pages(is_blocked);
+            }
+
+            // The whole transfer is copied when it starts, afterwards DMA only blocks the bus until dma_end_cycle
+            [[nodiscard]] bool is_dma_active() const { return emu_ref.get_total_machine_cycles() < dma_end_cycle; }
         private:
             enum {
                 rom_start_address = 0x0000,
                 rom_end_address = 0x7FFF,
 
                 vram_start_address = 0x8000,
+                tile_data_end_address = 0x97FF,
                 vram_end_address = 0x9FFF,
 
                 sram_start_address = 0xA000,
@@ -86,18 +163,35 @@ namespace emulator {
 
                 interrupt_enable_address = 0xFFFF,
 
-                dma_bytes_copied_amount = 0xA0
+                dma_bytes_copied_amount = 0xA0,
+                // One byte per machine cycle
+                dma_machine_cycles = dma_bytes_copied_amount
             };
 
+            // Pages of plain memory are read and written through these directly, the rest are nullptr and go
+            // through read_memory and write_memory. IO, OAM and cartridge RAM are never mapped, ROM and VRAM tile data
+            // only for reads.
+            static constexpr int page_bits = 8;
+            static constexpr int page_count = 0x100;
+            static constexpr word page_offset_mask = 0xFF;
 
-            void start_dma(byte upper_address_byte) {
-                dma_bytes_left = dma_bytes_copied_amount;
-                dma_source_address = utility::get_word_from_bytes(0, upper_address_byte);
-            }
+            std::array<const byte*, page_count> read_pages{};
+            std::array<byte*, page_count> write_pages{};
+            bool is_vram_unmapped{false};
 
-            int dma_bytes_left{0};
-            word dma_source_address{};
-            [[nodiscard]] bool is_dma_active() const { return dma_bytes_left > 0; }
+            // By the page of the address that was written, so echo RAM has its own pages
+            std::array<bool, page_count> dirty_pages{};
+            [[nodiscard]] bool is_any_page_dirty(word start_address, word end_address) const;
+
+            // Bank switches and disabling the boot ROM change what is mapped here
+            void map_rom_pages();
+            void map_vram_pages(bool is_blocked);
+
+            void start_dma(byte upper_address_byte);
+            // Where the DMA source is backed by a plain array, nullptr for the cartridge
+            const byte* get_dma_source_data(word address);
+
+            std::size_t dma_end_cycle{0};
 
             emulator& emu_ref;
 
@@ -114,8 +208,30 @@ namespace emulator {
 
         static constexpr duration frame_duration = std::chrono::nanoseconds((std::size_t)ns_per_frame);
 
+        static constexpr std::size_t no_deadline = std::numeric_limits<std::size_t>::max();
+
         std::size_t cycle_counter{};
+        std::size_t frame_counter{};
+        std::size_t fast_forwarded_cycle_counter{};
         time_point last_frame_time_point;
+        bool frame_rate_limited = true;
+
+        // The components don't run every cycle. The PPU is synced up to cycle_counter only when one of the components
+        // has an event, or the CPU accesses it, the timer computes its registers from the cycle they are accessed in.
+        // Events are the cycles in which a component could request an interrupt or change a register on its own.
+        std::size_t ppu_synced_cycle{};
+        std::size_t next_event_cycle{};
+
+        // cycle_counter is compared against cycle_limit every cycle, which is the next event, the end of the frame, or
+        // the end of the current run_cycles, whichever comes first
+        std::size_t cycle_limit{};
+        std::size_t run_deadline{no_deadline};
+        bool return_on_frame_end{false};
+        std::optional<run_result> pending_result;
+
+        std::vector<word> breakpoints;
+
+        cpu_bus bus;
 
         central_processing_unit::cpu cpu;
         timer emulated_timer;
@@ -127,29 +243,231 @@ namespace emulator {
 
         memory_map memory;
 
-        byte read_with_cycling(word address);
-        void write_with_cycling(word address, byte value);
-        void run_machine_cycle();
+        frontend::input_source& input;
 
-        void sleep_if_frame_time_too_short(time_point frame_current_time);
+        // Whatever else the CPU reads or writes doesn't depend on the components
+        static constexpr bool is_ppu_address(word address) {
+            if (address < 0xA000)
+                return address >= 0x8000;
+            if (address < 0xFE00)
+                return false;
+            if (address < 0xFF00)
+                return address <= 0xFE9F;
 
-        void stop_loop();
+            return address >= 0xFF40 && address <= 0xFF4B;
+        }
+        static constexpr bool is_timer_address(word address) { return address >= 0xFF04 && address <= 0xFF07; }
 
+        byte read_with_cycling(word address) {
+            if (is_ppu_address(address))
+                sync_ppu();
 
-    public:
-        emulator(SDL_Renderer *renderer, std::string_view boot_rom_path, std::string_view rom_path, std::string_view
-        sram_path);
+            byte value = memory.read_from_address(address);
+            run_machine_cycle();
+            return value;
+        }
+        void write_with_cycling(word address, byte value) {
+            run_machine_cycle();
 
-        void execute_cpu() {
-            try {
-                cpu.execute();
-            }
-            catch (const stop&) {
-                emulated_timer.write_divider(0);
-                stop_loop();
+            bool is_ppu_write = is_ppu_address(address);
+            if (!is_ppu_write && !is_timer_address(address)) {
+                memory.write_to_address(address, value);
+                return;
             }
+
+            // Writes can start DMA, turn the LCD or the counter on or off, or change its speed
+            if (is_ppu_write)
+                sync_components();
+            memory.write_to_address(address, value);
+            if (is_ppu_write)
+                memory.update_vram_pages();
+            schedule_next_event();
+        }
+
+        void run_machine_cycle() {
+            cycle_counter++;
+
+            if (cycle_counter >= cycle_limit)
+                handle_cycle_limit();
+        }
+
+        // Components are only synced at events, so the event has to be recomputed after every write to them
+        void schedule_next_event() {
+            std::size_t ppu_event = ppu_synced_cycle + ppu.get_machine_cycles_to_next_event() + 1;
+            // Both no_overflow and the overflow are after the start of the frame
+            std::size_t timer_event = emulated_timer.get_overflow_machine_cycle() - frame_counter * m_cycles_per_frame;
+
+            next_event_cycle = std::min(ppu_event, timer_event);
+            update_cycle_limit();
+        }
+
+        void sync_ppu() {
+            ppu.run_machine_cycles(static_cast<int>(cycle_counter - ppu_synced_cycle));
+            ppu_synced_cycle = cycle_counter;
+            memory.update_vram_pages();
+        }
+        void sync_components();
+
+        // Until the next event, no component can request an interrupt or end the frame, so the CPU can't notice
+        // anything if all of these cycles pass at once
+        [[nodiscard]] std::size_t get_machine_cycles_to_next_event() const {
+            // The cycle that ends the frame, or the run, or has an event, has to run normally
+            return cycle_limit - 1 - cycle_counter;
+        }
+
+        void run_machine_cycles_in_bulk(std::size_t cycles) {
+            cycle_counter += cycles;
+            fast_forwarded_cycle_counter += cycles;
+        }
+
+        void run_until_next_event() {
+            std::size_t cycles = get_machine_cycles_to_next_event();
+            if (cycles > 0)
+                run_machine_cycles_in_bulk(cycles);
+        }
+
+        void update_cycle_limit() {
+            cycle_limit = std::min<std::size_t>(m_cycles_per_frame, next_event_cycle);
+
+            std::size_t frame_start = frame_counter * m_cycles_per_frame;
+            if (run_deadline > frame_start + cycle_counter)
+                cycle_limit = std::min(cycle_limit, run_deadline - frame_start);
+        }
+
+        void handle_cycle_limit();
+        void end_frame();
+        void sleep_if_frame_time_too_short(time_point frame_current_time);
+        // Only sleeps if the frame rate is limited
+        void limit_frame_rate();
+
+        // The first reason wins, the CPU returns after the instruction it is executing
+        void finish_run(run_result result) {
+            if (!pending_result)
+                pending_result = result;
+            cpu.request_return();
+        }
+
+        // Everything an emulator does depends only on this state, and on the ROM
+        template<typename visitor> void visit_state(visitor& visit) {
+            machine_state::visit_members(visit, cycle_counter, frame_counter, ppu_synced_cycle);
+            cpu.visit_state(visit);
+            emulated_timer.visit_state(visit);
+            ppu.visit_state(visit);
+            buttons.visit_state(visit);
+            cart.visit_state(visit);
+            ram.visit_state(visit);
+            memory.visit_state(visit);
+        }
+        // Everything that isn't part of the state is derived from it again
+        void restore_derived_state();
+
+        run_result run(std::size_t machine_cycles, bool until_frame_end);
+        [[nodiscard]] bool is_at_breakpoint() const;
+        // Polls the input once, the CPU wakes up if one of the emulator's keys was pressed
+        void poll_input_while_stopped();
+
+
+    public:
+        emulator(frontend::frame_sink& frames, frontend::input_source& input, std::string_view boot_rom_path,
+                 std::string_view rom_path, std::string_view sram_path);
+
+        // All of these return once the reason happened, after the instruction (or with the block cache, the block)
+        // that caused it. Frames keep running while the CPU is halted, and end inside the run methods.
+        run_result run_cycles(std::size_t machine_cycles) { return run(machine_cycles, false); }
+        run_result run_frame() { return run(no_deadline, true); }
+        // Runs up to and including the next cycle in which a component could request an interrupt, or the frame ends
+        run_result run_until_event() { return run(get_machine_cycles_to_next_event() + 1, true); }
+
+        // Same as the run methods, but returns after every block, used for running two emulators side by side
+        run_result step_cpu();
+
+        // Save states are a header followed by the bytes of the state, in the order visit_state lists them. They can
+        // only be loaded by a build for the same platform, into an emulator running the same ROM. Has to be bumped
+        // whenever the state of any component changes.
+        static constexpr std::uint32_t state_format_version = 2;
+        [[nodiscard]] std::size_t get_state_size();
+        // Doesn't allocate, returns how many bytes were written. Throws if the buffer is smaller than get_state_size.
+        std::size_t save_state(std::span<byte> buffer);
+        // Throws if the buffer doesn't hold a state of this version and size, the emulator is unchanged then
+        void load_state(std::span<const byte> buffer);
+
+        // Splits a save state into pages, and sets dirty[i] to 1 if page i could have changed since the last call.
+        // Other pages are left as they are, so calls can be accumulated. Only WRAM and VRAM are tracked, pages that
+        // hold anything else are always dirty, and so is everything after a state was copied or loaded.
+        static constexpr std::size_t state_page_size = 0x100;
+        void collect_dirty_state_pages(std::span<byte> dirty);
+
+        // Sends the frame the PPU drew last to the frame sink again, and waits like at the end of a frame
+        void present_current_frame();
+
+        // Checked before every instruction, but only while there are any, otherwise the CPU runs in a tight loop
+        void add_breakpoint(word address) { breakpoints.push_back(address); }
+        void remove_breakpoint(word address) { std::erase(breakpoints, address); }
+
+        // Without the limit, frames are emulated as fast as possible, and the emulator never sleeps
+        void set_frame_rate_limited(bool limited) { frame_rate_limited = limited; }
+        [[nodiscard]] bool is_frame_rate_limited() const { return frame_rate_limited; }
+        void set_jit_enabled(bool enabled) { cpu.set_jit_enabled(enabled); }
+
+        [[nodiscard]] const central_processing_unit::cpu& get_cpu() const { return cpu; }
+        [[nodiscard]] const pixel_processing_unit::tile_cache::statistics& get_tile_cache_statistics() const {
+            return ppu.get_tile_cache_statistics();
+        }
+        [[nodiscard]] std::size_t get_frame_count() const { return frame_counter; }
+        // Machine cycles that were run in bulk, instead of one by one
+        [[nodiscard]] std::size_t get_fast_forwarded_machine_cycles() const { return fast_forwarded_cycle_counter; }
+        [[nodiscard]] std::size_t get_total_machine_cycles() const {
+            return frame_counter * m_cycles_per_frame + cycle_counter;
         }
     };
+
+    inline byte cpu_bus::read_memory(word address) { return emu_ref.read_with_cycling(address); }
+    inline void cpu_bus::write_memory(word address, byte value) { emu_ref.write_with_cycling(address, value); }
+    inline void cpu_bus::run_phantom_cycle() { emu_ref.run_machine_cycle(); }
+    inline void cpu_bus::run_until_next_event() { emu_ref.run_until_next_event(); }
+    inline void cpu_bus::fast_forward(std::size_t machine_cycles) {
+        emu_ref.run_machine_cycles_in_bulk(machine_cycles);
+    }
+    inline std::size_t cpu_bus::get_machine_cycles_to_next_event() {
+        return emu_ref.get_machine_cycles_to_next_event();
+    }
+    inline std::size_t cpu_bus::get_machine_cycle_count() { return emu_ref.get_total_machine_cycles(); }
+
+    static_assert(cartridge::boot_rom_bank == central_processing_unit::block_cache::boot_rom_bank);
+
+    inline byte cpu_bus::peek_rom(word address) { return emu_ref.cart.read_rom(address); }
+    inline int cpu_bus::get_rom_bank(word address) { return emu_ref.cart.get_rom_bank(address); }
+    inline dword cpu_bus::get_rom_mapping_generation() { return emu_ref.cart.get_rom_mapping_generation(); }
+    inline bool cpu_bus::is_dma_active() { return emu_ref.memory.is_dma_active(); }
+}
+
+namespace central_processing_unit {
+    inline byte cpu::read_byte(word address) { return bus.read_memory(address); }
+    inline void cpu::write_byte(word address, byte value) { bus.write_memory(address, value); }
+    inline void cpu::run_phantom_cycle() { bus.run_phantom_cycle(); }
+
+    inline bool cpu::is_at(const decoded_instruction& instruction) {
+        return current_state == state::running &&
+               registers.whole.PC == static_cast<word>(instruction.address + 1) &&
+               cached_instruction == instruction.opcode &&
+               fetch_block_generation == bus.get_rom_mapping_generation() &&
+               !bus.is_dma_active();
+    }
+
+    inline byte cpu::read_byte_at_pc() {
+#if defined(CPU_BLOCK_CACHE)
+        word address = registers.whole.PC;
+
+        // During DMA the CPU reads 0xFF from ROM, so that case has to go through the memory map
+        if (fetch_block != nullptr && fetch_block->contains(address) &&
+            fetch_block_generation == bus.get_rom_mapping_generation() && !bus.is_dma_active()) {
+            byte value = fetch_block->read(address);
+            run_phantom_cycle();
+            return value;
+        }
+#endif
+        return read_byte(registers.whole.PC);
+    }
 }
 
 #endif //SEMESTER_PROJECT_EMULATOR_HPP
@@ -16,8 +16,8 @@ namespace emulator {
             // Serial communication registers NOT IMPLEMENTED
 
             // Timer registers
-            case 0x04: return emu_ref.emulated_timer.read_divider();
-            case 0x05: return emu_ref.emulated_timer.read_counter();
+            case 0x04: return emu_ref.emulated_timer.read_divider(emu_ref.get_total_machine_cycles());
+            case 0x05: return emu_ref.emulated_timer.read_counter(emu_ref.get_total_machine_cycles());
             case 0x06: return emu_ref.emulated_timer.read_modulo();
             case 0x07: return emu_ref.emulated_timer.read_control();
 
@@ -55,10 +55,10 @@ namespace emulator {
                 // Serial communication registers NOT IMPLEMENTED
 
                 // Timer registers
-            case 0x04: emu_ref.emulated_timer.write_divider(value); break;
-            case 0x05: emu_ref.emulated_timer.write_counter(value); break;
+            case 0x04: emu_ref.emulated_timer.write_divider(emu_ref.get_total_machine_cycles()); break;
+            case 0x05: emu_ref.emulated_timer.write_counter(value, emu_ref.get_total_machine_cycles()); break;
             case 0x06: emu_ref.emulated_timer.write_modulo(value); break;
-            case 0x07: emu_ref.emulated_timer.write_control(value); break;
+            case 0x07: emu_ref.emulated_timer.write_control(value, emu_ref.get_total_machine_cycles()); break;
 
                 // Interrupt flag
             case 0x0F: emu_ref.cpu.interrupt_requested_register = value; break;
@@ -84,7 +84,10 @@ namespace emulator {
             case 0x4A: emu_ref.ppu.write_window_y(value); break;
             case 0x4B: emu_ref.ppu.write_window_x(value); break;
 
-            case 0x50: emu_ref.cart.write_boot_rom_disable(value); break;
+            case 0x50:
+                emu_ref.cart.write_boot_rom_disable(value);
+                map_rom_pages();
+                break;
 
             default: break;
         }
@@ -0,0 +1,54 @@
+// File: frame_sink.hpp
+//
+// Created by Adrian Habusta on 17.10.2026
+//
+
+#ifndef SEMESTER_PROJECT_FRAME_SINK_HPP
+#define SEMESTER_PROJECT_FRAME_SINK_HPP
+
+#include <algorithm>
+#include <cstddef>
+
+#include "../hardware/ppu_data.hpp"
+
+namespace frontend {
+    using frame_buffer = pixel_processing_unit::palette::real_pixel_type
+            [pixel_processing_unit::screen_pixel_height][pixel_processing_unit::screen_pixel_width];
+
+    // Receives every frame the PPU finishes, at the start of VBlank
+    class frame_sink {
+    public:
+        virtual void present_frame(const frame_buffer& frame) = 0;
+        // Sent instead of frames while the LCD is off
+        virtual void present_blank_frame() = 0;
+
+        virtual ~frame_sink() = default;
+    };
+
+    class null_frame_sink : public frame_sink {
+    public:
+        void present_frame(const frame_buffer& frame [[maybe_unused]]) override {}
+        void present_blank_frame() override {}
+    };
+
+    // Keeps the last frame, for running without a display
+    class memory_frame_sink : public frame_sink {
+        frame_buffer last_frame{};
+        std::size_t presented_frames{};
+
+    public:
+        void present_frame(const frame_buffer& frame) override {
+            std::copy_n(&frame[0][0], std::size(frame) * std::size(frame[0]), &last_frame[0][0]);
+            ++presented_frames;
+        }
+        void present_blank_frame() override {
+            std::fill_n(&last_frame[0][0], std::size(last_frame) * std::size(last_frame[0]), 0);
+            ++presented_frames;
+        }
+
+        [[nodiscard]] const frame_buffer& get_frame() const { return last_frame; }
+        [[nodiscard]] std::size_t get_presented_frame_count() const { return presented_frames; }
+    };
+}
+
+#endif //SEMESTER_PROJECT_FRAME_SINK_HPP
@@ -0,0 +1,47 @@
+// File: input_source.hpp
+//
+// Created by Adrian Habusta on 17.10.2026
+//
+
+#ifndef SEMESTER_PROJECT_INPUT_SOURCE_HPP
+#define SEMESTER_PROJECT_INPUT_SOURCE_HPP
+
+#include <optional>
+
+namespace frontend {
+    enum class button {
+        right, left, up, down,
+        a, b, select, start
+    };
+
+    struct input_event {
+        enum class type {
+            button_pressed,
+            button_released,
+            // The window was closed, or the frontend wants the emulator to stop for another reason
+            quit
+        };
+
+        type event_type;
+        // Not used by quit
+        button changed_button{};
+    };
+
+    // Polled by the emulator once per frame, and while the CPU is stopped
+    class input_source {
+    public:
+        // Returns nothing once there are no more pending events
+        virtual std::optional<input_event> poll_event() = 0;
+        // Polled by the main loop, not the emulator, so it must not take any events from the queue
+        [[nodiscard]] virtual bool is_rewind_held() { return false; }
+
+        virtual ~input_source() = default;
+    };
+
+    class null_input_source : public input_source {
+    public:
+        std::optional<input_event> poll_event() override { return std::nullopt; }
+    };
+}
+
+#endif //SEMESTER_PROJECT_INPUT_SOURCE_HPP
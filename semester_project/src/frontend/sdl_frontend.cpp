@@ -0,0 +1,82 @@
+// File: sdl_frontend.cpp
+//
+// Created by Adrian Habusta on 17.10.2026
+//
+
+#include <cstring>
+
+#include "sdl_frontend.hpp"
+
+namespace frontend {
+    sdl_frame_sink::sdl_frame_sink(SDL_Renderer* renderer) : renderer(renderer) {
+        texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+                                    pixel_processing_unit::screen_pixel_width,
+                                    pixel_processing_unit::screen_pixel_height);
+    }
+
+    sdl_frame_sink::~sdl_frame_sink() {
+        SDL_DestroyTexture(texture);
+    }
+
+    void sdl_frame_sink::present_frame(const frame_buffer& frame) {
+        SDL_RenderClear(renderer);
+
+        void* pixels;
+        int discard;
+        SDL_LockTexture(texture, nullptr, &pixels, &discard);
+        std::memcpy(pixels, frame, sizeof(frame_buffer));
+        SDL_UnlockTexture(texture);
+
+        SDL_RenderCopy(renderer, texture, nullptr, nullptr);
+        SDL_RenderPresent(renderer);
+    }
+
+    void sdl_frame_sink::present_blank_frame() {
+        SDL_RenderClear(renderer);
+        SDL_RenderPresent(renderer);
+    }
+
+    std::optional<button> sdl_input_source::get_button(SDL_Keycode key) {
+        switch (key) {
+            case SDLK_RIGHT: return button::right;
+            case SDLK_LEFT: return button::left;
+            case SDLK_UP: return button::up;
+            case SDLK_DOWN: return button::down;
+
+            case SDLK_z: return button::a;
+            case SDLK_x: return button::b;
+            case SDLK_SPACE: return button::select;
+            case SDLK_RETURN: return button::start;
+
+            default: return std::nullopt;
+        }
+    }
+
+    bool sdl_input_source::is_rewind_held() {
+        // Only updates the keyboard state, the events stay queued for the emulator
+        SDL_PumpEvents();
+        return SDL_GetKeyboardState(nullptr)[SDL_SCANCODE_BACKSPACE] != 0;
+    }
+
+    std::optional<input_event> sdl_input_source::poll_event() {
+        SDL_Event event;
+        while (SDL_PollEvent(&event)) {
+            if (event.type == SDL_QUIT)
+                return input_event{input_event::type::quit};
+
+            if (event.type != SDL_KEYDOWN && event.type != SDL_KEYUP)
+                continue;
+
+            // Other keys are skipped, as if they were never pressed
+            auto changed_button = get_button(event.key.keysym.sym);
+            if (!changed_button)
+                continue;
+
+            auto type = event.type == SDL_KEYDOWN ? input_event::type::button_pressed
+                                                  : input_event::type::button_released;
+            return input_event{type, *changed_button};
+        }
+
+        return std::nullopt;
+    }
+}
@@ -0,0 +1,42 @@
+// File: sdl_frontend.hpp
+//
+// Created by Adrian Habusta on 17.10.2026
+//
+
+#ifndef SEMESTER_PROJECT_SDL_FRONTEND_HPP
+#define SEMESTER_PROJECT_SDL_FRONTEND_HPP
+
+#include <SDL.h>
+
+#include "frame_sink.hpp"
+#include "input_source.hpp"
+
+namespace frontend {
+    // Draws frames into a streaming texture that covers the whole window
+    class sdl_frame_sink : public frame_sink {
+        SDL_Renderer* renderer;
+        SDL_Texture* texture;
+
+    public:
+        explicit sdl_frame_sink(SDL_Renderer* renderer);
+        ~sdl_frame_sink() override;
+
+        sdl_frame_sink(const sdl_frame_sink&) = delete;
+        sdl_frame_sink& operator=(const sdl_frame_sink&) = delete;
+
+        void present_frame(const frame_buffer& frame) override;
+        void present_blank_frame() override;
+    };
+
+    // Keys are not remappable right now
+    class sdl_input_source : public input_source {
+        static std::optional<button> get_button(SDL_Keycode key);
+
+    public:
+        std::optional<input_event> poll_event() override;
+        // Backspace
+        [[nodiscard]] bool is_rewind_held() override;
+    };
+}
+
+#endif //SEMESTER_PROJECT_SDL_FRONTEND_HPP
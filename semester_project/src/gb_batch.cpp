@@ -0,0 +1,104 @@
+// File: gb_batch.cpp
+//
+// Created by Adrian Habusta on 17.10.2026
+//
+
+// Runs every job of a manifest (see batch/job.hpp) on headless emulators, spread over all cores. Prints one line of
+// results per job, and a summary of the throughput for sizing machines.
+
+#include <string_view>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "batch/work_stealing_pool.hpp"
+#include "batch/job.hpp"
+
+void print_result(const batch::job& finished_job, const batch::job_result& result) {
+    std::cout << finished_job.name << '\t' << (result.succeeded ? (result.stopped_early ? "stopped" : "ok") : "failed")
+              << '\t' << result.frames << '\t' << result.machine_cycles << '\t'
+              << std::hex << std::setfill('0') << std::setw(16) << result.frame_hash << '\t'
+              << std::setw(16) << result.state_hash << std::dec << std::setfill(' ') << '\t'
+              << result.tile_cache_hits << '\t' << result.tile_cache_misses << '\t'
+              << result.analyzed_loops << '\t' << result.idle_loops << '\t'
+              << result.fast_forwards << '\t' << result.fast_forwarded_machine_cycles << '\t'
+              << result.seconds << '\t' << result.error << std::endl;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cout << "Usage: gb_batch manifest [--threads count]" << std::endl;
+        return 1;
+    }
+
+    std::string_view manifest_path = argv[1];
+    std::size_t thread_count = std::thread::hardware_concurrency();
+
+    for (int i = 2; i < argc; ++i) {
+        std::string_view argument = argv[i];
+        if (argument == "--threads" && i + 1 < argc) {
+            try {
+                thread_count = std::stoul(argv[++i]);
+            }
+            catch (const std::exception&) {
+                std::cout << "Expected a thread count after --threads." << std::endl;
+                return 1;
+            }
+        }
+        else {
+            std::cout << "Unknown argument " << argument << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<batch::job> jobs;
+    try {
+        jobs = batch::read_manifest(manifest_path);
+    }
+    catch (const std::exception& e) {
+        std::cout << e.what() << std::endl;
+        return 1;
+    }
+
+    // Every job writes only to its own result, nothing else is shared between the threads
+    std::vector<batch::job_result> results(jobs.size());
+    batch::work_stealing_pool pool(thread_count);
+
+    auto start = std::chrono::steady_clock::now();
+    std::size_t used_threads = pool.run(jobs.size(), [&](std::size_t index) {
+        results[index] = batch::run_job(jobs[index]);
+    });
+    double wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "# name\tstatus\tframes\tmachine_cycles\tframe_hash\tstate_hash\ttile_hits\ttile_misses"
+              << "\tanalyzed_loops\tidle_loops\tfast_forwards\tfast_forwarded_cycles\tseconds\terror" << std::endl;
+
+    std::size_t failed_jobs = 0;
+    std::size_t total_frames = 0;
+    double job_seconds = 0;
+    for (std::size_t i = 0; i < jobs.size(); ++i) {
+        print_result(jobs[i], results[i]);
+
+        failed_jobs += !results[i].succeeded;
+        total_frames += results[i].frames;
+        job_seconds += results[i].seconds;
+    }
+
+    // Per thread only counts the threads that had a job, there are fewer than requested when there are fewer jobs. Per
+    // core is measured from the time spent in the jobs, so it doesn't depend on how well they were balanced.
+    double threads = static_cast<double>(std::max<std::size_t>(used_threads, 1));
+    std::cout << "# " << jobs.size() << " jobs (" << failed_jobs << " failed) on " << used_threads
+              << " threads in " << wall_seconds << " s" << std::endl;
+    std::cout << "# " << jobs.size() / wall_seconds << " instances/s, " << total_frames / wall_seconds
+              << " frames/s, " << total_frames / wall_seconds / threads << " frames/s per thread" << std::endl;
+    if (job_seconds > 0) {
+        std::cout << "# " << jobs.size() / job_seconds << " instances/s and " << total_frames / job_seconds
+                  << " frames/s per busy core" << std::endl;
+    }
+
+    return failed_jobs == 0 ? 0 : 1;
+}
@@ -10,29 +10,45 @@
 #include <memory>
 
 #include "cartridge_memory_controllers.hpp"
+#include "../machine_state.hpp"
 #include "../utility.hpp"
 
 
 class cartridge {
     static constexpr int boot_rom_size = 0x100;
+    static constexpr word switchable_bank_start_address = 0x4000;
 
     std::unique_ptr<cartridge_mbc> mbc;
 
     bool boot_rom_enabled = true;
     byte boot_rom_register{};
 
+    // Bumped every time the memory visible at 0x0000-0x7FFF changes, so that decoded code can be dropped
+    dword rom_mapping_generation{};
+
     void save_boot_rom(std::string_view boot_rom_path) {
         utility::read_file(boot_rom_path, boot_rom, boot_rom_size, "Failed to load boot rom");
     }
 
     byte boot_rom[boot_rom_size] {0};
 public:
+    static constexpr int boot_rom_bank = 0xFFFF;
+
     cartridge(std::string_view boot_rom_path, std::string_view rom_path, std::string_view sram_path);
 
+    template<typename visitor> void visit_state(visitor& visit) {
+        machine_state::visit_members(visit, boot_rom_enabled, boot_rom_register);
+        mbc->visit_state([&](std::span<byte> bytes) { visit(bytes); });
+    }
+    // Has to be called after the state was changed from outside, anything decoded from ROM might not match anymore
+    void invalidate_rom_mapping() { ++rom_mapping_generation; }
+
     [[nodiscard]] byte read_boot_rom_disable() const { return boot_rom_register; }
     void write_boot_rom_disable(byte value) {
-        if (value > 0)
+        if (value > 0 && boot_rom_enabled) {
             boot_rom_enabled = false;
+            ++rom_mapping_generation;
+        }
 
         boot_rom_register = value;
     }
@@ -44,13 +60,37 @@ public:
         return mbc->read_rom(address);
     }
 
+    // Only valid until the next write to ROM or the boot ROM register, nullptr if reads have to go through read_rom
+    [[nodiscard]] const byte* get_rom_data(word address) const {
+        if (boot_rom_enabled && address < boot_rom_size)
+            return boot_rom + address;
+
+        return mbc->get_rom_data(address);
+    }
+
+    // Boot ROM gets its own bank number, so it can't be confused with bank 0
+    [[nodiscard]] int get_rom_bank(word address) const {
+        if (boot_rom_enabled && address < boot_rom_size)
+            return boot_rom_bank;
+        if (address < switchable_bank_start_address)
+            return 0;
+
+        return mbc->get_rom_bank();
+    }
+
+    [[nodiscard]] dword get_rom_mapping_generation() const { return rom_mapping_generation; }
+
     byte read_ram(word address) {
         return mbc->read_ram(address);
     }
 
     // This is used for controlling the MBC
     void write_rom(word address, byte value) {
+        int previous_bank = mbc->get_rom_bank();
         mbc->write_rom(address, value);
+
+        if (mbc->get_rom_bank() != previous_bank)
+            ++rom_mapping_generation;
     }
 
     void write_ram(word address, byte value) {
@@ -7,6 +7,7 @@
 #define SEMESTER_PROJECT_CARTRIDGE_MEMORY_CONTROLLERS_HPP
 
 #include <string_view>
+#include "../machine_state.hpp"
 #include "../utility.hpp"
 
 class cartridge_mbc {
@@ -17,8 +18,16 @@ public:
     virtual void load_sram_from_file(std::string_view path [[maybe_unused]]) {};
 
     [[nodiscard]] virtual byte read_rom(word address) const = 0;
+    // Where the ROM at this address is stored, if it can be read directly until the next write to the MBC
+    [[nodiscard]] virtual const byte* get_rom_data(word address [[maybe_unused]]) const { return nullptr; }
     [[nodiscard]] virtual byte read_ram(word address [[maybe_unused]]) const { return utility::undefined_byte; };
 
+    // The bank currently mapped to 0x4000-0x7FFF
+    [[nodiscard]] virtual int get_rom_bank() const { return 1; }
+
+    // Bank registers and RAM, the ROM itself isn't state
+    virtual void visit_state(const machine_state::byte_visitor& visit [[maybe_unused]]) {}
+
     virtual void write_rom(word address [[maybe_unused]], byte value [[maybe_unused]]) {};
     virtual void write_ram(word address [[maybe_unused]], byte value [[maybe_unused]]) {};
 
@@ -33,6 +42,7 @@ public:
     void load_rom_from_file(std::string_view path) override;
 
     [[nodiscard]] byte read_rom(word address) const override { return rom[address]; };
+    [[nodiscard]] const byte* get_rom_data(word address) const override { return rom + address; }
 };
 
 #endif //SEMESTER_PROJECT_CARTRIDGE_MEMORY_CONTROLLERS_HPP
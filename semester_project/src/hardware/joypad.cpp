@@ -6,43 +6,49 @@
 #include "../emulator.hpp"
 #include "joypad.hpp"
 
-void joypad::handle_input() {
-    SDL_Event event;
-    while (SDL_PollEvent(&event)) {
-        switch (event.type) {
-            case SDL_QUIT: throw emulator::exit();
-            case SDL_KEYDOWN: update_pressed_keys_from_event(event); break;
-            case SDL_KEYUP: update_released_keys_from_event(event); break;
-
-            default: break;
+bool joypad::handle_input(frontend::input_source& input) {
+    bool quit_requested = false;
+
+    while (auto event = input.poll_event()) {
+        switch (event->event_type) {
+            case frontend::input_event::type::quit: quit_requested = true; break;
+            case frontend::input_event::type::button_pressed: update_key(event->changed_button, false); break;
+            case frontend::input_event::type::button_released: update_key(event->changed_button, true); break;
         }
     }
 
     update_joypad_status();
+    return quit_requested;
 }
 
-// Keys are not remappable right now
-void joypad::update_keys_from_event(SDL_Event &event, bool new_value) {
-    byte new_direction = joypad_direction_keys_state;
-    byte new_action = joypad_action_keys_state;
-
-    switch (event.key.keysym.sym) {
-        case SDLK_UP: new_direction = utility::write_bit(joypad_direction_keys_state, key_up_pos, new_value); break;
-        case SDLK_DOWN: new_direction = utility::write_bit(joypad_direction_keys_state, key_down_pos, new_value); break;
-        case SDLK_LEFT: new_direction = utility::write_bit(joypad_direction_keys_state, key_left_pos, new_value); break;
-        case SDLK_RIGHT: new_direction = utility::write_bit(joypad_direction_keys_state, key_right_pos, new_value);
+void joypad::update_key(frontend::button changed_button, bool new_value) {
+    switch (changed_button) {
+        case frontend::button::up:
+            joypad_direction_keys_state = utility::write_bit(joypad_direction_keys_state, key_up_pos, new_value);
+            break;
+        case frontend::button::down:
+            joypad_direction_keys_state = utility::write_bit(joypad_direction_keys_state, key_down_pos, new_value);
+            break;
+        case frontend::button::left:
+            joypad_direction_keys_state = utility::write_bit(joypad_direction_keys_state, key_left_pos, new_value);
+            break;
+        case frontend::button::right:
+            joypad_direction_keys_state = utility::write_bit(joypad_direction_keys_state, key_right_pos, new_value);
             break;
 
-        case SDLK_z: new_action = utility::write_bit(joypad_action_keys_state, key_a_pos, new_value); break;
-        case SDLK_x: new_action = utility::write_bit(joypad_action_keys_state, key_b_pos, new_value); break;
-        case SDLK_RETURN: new_action = utility::write_bit(joypad_action_keys_state, key_start_pos, new_value); break;
-        case SDLK_SPACE: new_action = utility::write_bit(joypad_action_keys_state, key_select_pos, new_value); break;
-
-        default: break;
+        case frontend::button::a:
+            joypad_action_keys_state = utility::write_bit(joypad_action_keys_state, key_a_pos, new_value);
+            break;
+        case frontend::button::b:
+            joypad_action_keys_state = utility::write_bit(joypad_action_keys_state, key_b_pos, new_value);
+            break;
+        case frontend::button::start:
+            joypad_action_keys_state = utility::write_bit(joypad_action_keys_state, key_start_pos, new_value);
+            break;
+        case frontend::button::select:
+            joypad_action_keys_state = utility::write_bit(joypad_action_keys_state, key_select_pos, new_value);
+            break;
     }
-
-    joypad_direction_keys_state = new_direction;
-    joypad_action_keys_state = new_action;
 }
 
 bool joypad::check_for_keys_high_to_low_transition(byte new_status) const {
@@ -6,13 +6,11 @@
 #ifndef SEMESTER_PROJECT_JOYPAD_HPP
 #define SEMESTER_PROJECT_JOYPAD_HPP
 
-#include <SDL.h>
-
-#include <utility>
-
 #include <utility>
 
 #include "../cpu/cpu_interrupt_typedef.hpp"
+#include "../frontend/input_source.hpp"
+#include "../machine_state.hpp"
 #include "../utility.hpp"
 
 class joypad {
@@ -47,10 +45,7 @@ class joypad {
     [[nodiscard]] bool check_for_keys_high_to_low_transition(byte new_status) const;
 
     // Inverted logic, pressed keys write 0, released keys 1
-    void update_pressed_keys_from_event(SDL_Event& event) { update_keys_from_event(event, false); }
-    void update_released_keys_from_event(SDL_Event& event) { update_keys_from_event(event, true); }
-
-    void update_keys_from_event(SDL_Event& event, bool new_value);
+    void update_key(frontend::button changed_button, bool new_value);
 
     [[nodiscard]] bool are_direction_keys_selected() const { return !utility::get_bit(joypad_status, read_direction_buttons_pos); }
     [[nodiscard]] bool are_action_keys_selected() const { return !utility::get_bit(joypad_status, read_action_buttons_pos); }
@@ -60,7 +55,12 @@ class joypad {
 public:
     explicit joypad(interrupt_callback&& callback) : request_joystick_interrupt(std::move(callback)) {}
 
-    void handle_input();
+    template<typename visitor> void visit_state(visitor& visit) {
+        machine_state::visit_members(visit, joypad_status, joypad_direction_keys_state, joypad_action_keys_state);
+    }
+
+    // Handles all pending events, returns true if the frontend asked to quit
+    [[nodiscard]] bool handle_input(frontend::input_source& input);
 
     void write_joypad_status(byte value);
     [[nodiscard]] byte read_joypad_status() const;
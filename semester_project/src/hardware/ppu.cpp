@@ -3,15 +3,71 @@
 // Created by Adrian Habusta on 24.04.2023
 //
 
+#include <algorithm>
+
 #include "ppu.hpp"
 
 namespace pixel_processing_unit {
-    void ppu::run_machine_cycle() {
+    int ppu::get_machine_cycles_to_next_event() const {
+        if (!is_powered_on)
+            return utility::no_limit;
+
+        return get_t_cycles_to_next_event() / t_cycles_per_m_cycle;
+    }
+
+    int ppu::get_t_cycles_to_next_event() const {
+        // Each t-cycle first counts down, and only moves to the next mode when remaining_t_cycles was already zero
+        int t_cycles_to_event = remaining_t_cycles;
+
+        if (current_mode == mode::v_blank) {
+            // LY is incremented whenever remaining_t_cycles hits a multiple of a scanline, including zero
+            int to_next_line = remaining_t_cycles % t_cycles_per_scanline;
+            if (to_next_line == 0)
+                to_next_line = t_cycles_per_scanline;
+
+            t_cycles_to_event = std::min(to_next_line - 1, remaining_t_cycles);
+        }
+
+        return t_cycles_to_event;
+    }
+
+    int ppu::get_span_t_cycles() const {
+        switch (current_mode) {
+            // Every cycle draws one pixel, which draw_pixels does for the whole span at once
+            case mode::pixel_transfer:
+                return remaining_t_cycles;
+
+            // OAM search only works on its very first cycle, right after the mode change, and the rest only changes
+            // something on events
+            default:
+                return get_t_cycles_to_next_event();
+        }
+    }
+
+    void ppu::run_machine_cycles(int count) {
         if (!is_powered_on)
             return;
 
-        for (int i = 0; i < t_cycles_per_m_cycle; i++)
-            run_t_cycle();
+        int t_cycles = count * t_cycles_per_m_cycle;
+        while (t_cycles > 0) {
+            int span_t_cycles = std::min(get_span_t_cycles(), t_cycles);
+
+            // Mode changes and LY increments
+            if (span_t_cycles == 0) {
+                run_t_cycle();
+                --t_cycles;
+                continue;
+            }
+
+            if (current_mode == mode::pixel_transfer) {
+                // Same x as run_pixel_transfer_t_cycle, which sees remaining_t_cycles after the decrement
+                int first_x = t_cycles_per_pixel_transfer - (remaining_t_cycles - 1);
+                draw_pixels(first_x, std::min(first_x + span_t_cycles, screen_pixel_width));
+            }
+
+            remaining_t_cycles -= span_t_cycles;
+            t_cycles -= span_t_cycles;
+        }
     }
 
     void ppu::run_t_cycle() {
@@ -38,7 +94,13 @@ namespace pixel_processing_unit {
         increment_line_counter_and_check_for_match();
 
         sprite::size sprite_size = registers.get_sprite_size();
-        current_line_sprites = oam.create_sprite_cache_for_line(registers.lcd_y, sprite_size);
+        const auto& line_sprites = sprites_by_line.get_line(oam, registers.lcd_y, sprite_size);
+
+        sprite_cache::factory cache_factory{};
+        for (int i = 0; i < line_sprites.count; ++i)
+            cache_factory.add_sprite(oam.sprites[line_sprites.indices[i]]);
+        current_line_sprites = cache_factory.create_cache();
+        is_sprite_line_drawn = false;
     }
 
     void ppu::run_pixel_transfer_t_cycle() {
@@ -47,140 +109,137 @@ namespace pixel_processing_unit {
         if (current_x >= screen_pixel_width)
             return;
 
-        auto actual_pixel = get_pixel(current_x);
-        renderer.save_pixel(current_x, registers.lcd_y, actual_pixel);
-    }
-
-    void ppu::run_h_blank_t_cycle() {
-        // Nothing happens here
+        draw_pixels(current_x, current_x + 1);
     }
 
-    void ppu::run_v_blank_t_cycle() {
-        // Render frame if first cycle
-        if (remaining_t_cycles == t_cycles_per_v_blank) {
-            renderer.render_frame();
-        }
-
-        if (remaining_t_cycles % t_cycles_per_scanline == 0) {
-            increment_line_counter_and_check_for_match();
+    void ppu::draw_pixels(int first_x, int end_x) {
+        // Indexed by x, so that the span can start anywhere in the line
+        byte background_pixels[screen_pixel_width]{};
+
+        if (registers.get_bg_window_display_priority()) {
+            int window_start_x = end_x;
+            if (registers.get_window_draw_enable() && registers.lcd_y >= registers.window_y)
+                window_start_x = std::clamp(registers.window_x - 7, first_x, end_x);
+
+            const auto& background_map = registers.get_bg_tile_map_select() ? vram.tiles.tile_map_1
+                                                                             : vram.tiles.tile_map_0;
+            get_layer_pixels(background_map, first_x + registers.scroll_x,
+                             (registers.lcd_y + registers.scroll_y) & 0xFF, window_start_x - first_x,
+                             background_pixels + first_x);
+
+            const auto& window_map = registers.get_window_tile_map_select() ? vram.tiles.tile_map_1
+                                                                             : vram.tiles.tile_map_0;
+            get_layer_pixels(window_map, window_start_x - (registers.window_x - 7),
+                             registers.lcd_y - registers.window_y, end_x - window_start_x,
+                             background_pixels + window_start_x);
         }
-    }
 
-    palette::real_pixel_type ppu::get_pixel(int x) {
-        palette::pixel bg_pixel{0};
+        static constexpr byte no_sprites[screen_pixel_width]{};
+        const byte* sprite_pixels = no_sprites;
 
-        bool draw_bg_elements = registers.get_bg_window_display_priority();
-        if (draw_bg_elements) {
-            if (check_if_in_window(x) && registers.get_window_draw_enable())
-                bg_pixel = get_pixel_from_window_layer(x);
-            else
-                bg_pixel = get_pixel_from_background_layer(x);
+        if (registers.get_sprite_draw_enable()) {
+            // The size is the only thing the sprites are drawn from that can still change during pixel transfer
+            if (!is_sprite_line_drawn || sprite_line_size != registers.get_sprite_size())
+                draw_sprite_line();
+            sprite_pixels = sprite_line;
         }
 
-        // SPRITE DRAWING
-        if (!registers.get_sprite_draw_enable()) {
-            return registers.background_palette.convert_to_real_pixel(bg_pixel);
-        }
+        kernels::color_table colors{};
+        auto copy_palette = [&](const palette& source, int offset) {
+            auto real_pixels = source.get_real_pixels();
+            std::copy(real_pixels.begin(), real_pixels.end(), colors.begin() + offset);
+        };
+        copy_palette(registers.background_palette, 0);
+        copy_palette(registers.sprite_palette_0, kernels::sprite_palette_0_offset);
+        copy_palette(registers.sprite_palette_1, kernels::sprite_palette_1_offset);
+
+        kernels::get_best_kernels().compose_line(background_pixels + first_x, sprite_pixels + first_x, end_x - first_x,
+                                                 colors, renderer.get_line(registers.lcd_y) + first_x);
+    }
 
-        std::optional<sprite> current_sprite = current_line_sprites->get_first_sprite_at_current_x(x);
+    void ppu::get_layer_pixels(const tile_data::map& tile_map, int layer_x, int layer_y, int count,
+                               byte* pixels) {
+        bool method = registers.get_bg_and_window_tile_data_select();
 
-        if (!current_sprite) {
-            // Return bg if there is no sprite
-            return registers.background_palette.convert_to_real_pixel(bg_pixel);
-        }
-        auto sprite_size = registers.get_sprite_size();
+        int tile_number_y = layer_y / tile::size;
+        int tile_y = layer_y % tile::size;
 
-        palette::pixel sprite_pixel = get_pixel_from_sprite(x, *current_sprite, sprite_size);
+        while (count > 0) {
+            auto tile_index = tile_map.get_tile_index(layer_x / tile::size, tile_number_y);
+            int tile_number = tile_data::get_tile_number_bg_and_window(tile_index, method);
+            const byte* tile_row = decoded_tiles.get_row(vram.tiles.tiles, tile_number, tile_y, false);
 
-        while (sprite_pixel.is_transparent()) {
-            current_sprite = current_line_sprites->get_next_sprite_at_current_x(x);
-            if (!current_sprite) {
-                // Return bg if there is no non-transparent sprite
-                return registers.background_palette.convert_to_real_pixel(bg_pixel);
-            }
-            sprite_pixel = get_pixel_from_sprite(x, *current_sprite, sprite_size);
-        }
+            // Only the first tile can be entered in the middle
+            int tile_x = layer_x % tile::size;
+            int copied = std::min(tile::size - tile_x, count);
+            std::copy_n(tile_row + tile_x, copied, pixels);
 
-        if (current_sprite->get_priority() && !bg_pixel.is_transparent()) {
-            // Return bg if "bg over sprite" priority is set and bg is not transparent
-            return registers.background_palette.convert_to_real_pixel(bg_pixel);
+            pixels += copied;
+            layer_x += copied;
+            count -= copied;
         }
-
-        // Return sprite otherwise
-        bool palette_index = current_sprite->get_palette_number();
-        palette sprite_palette = palette_index ? registers.sprite_palette_1 : registers.sprite_palette_0;
-
-        return sprite_palette.convert_to_real_pixel(sprite_pixel);
     }
 
-    palette::pixel ppu::get_pixel_from_sprite(int x, sprite current_sprite, sprite::size sprite_size) const {
-        int sprite_width = sprite::width;
-        int sprite_height = sprite::get_height_from_size(sprite_size);
-
-        int sprite_x = x - current_sprite.get_x() + sprite::x_offset;
-        int sprite_y = registers.lcd_y - current_sprite.get_y() + sprite::y_offset;
-
-        if (current_sprite.get_x_flip())
-            sprite_x = sprite_width - sprite_x - 1;
-        if (current_sprite.get_y_flip())
-            sprite_y = sprite_height - sprite_y - 1;
-
+    void ppu::draw_sprite_line() {
+        std::fill(std::begin(sprite_line), std::end(sprite_line), 0);
 
-        auto tile_number = current_sprite.get_tile_number();
-        tile_number = sprite::get_correct_tile_index_for_size(tile_number, sprite_y, sprite_size);
+        auto sprite_size = registers.get_sprite_size();
+        int sprite_height = sprite::get_height_from_size(sprite_size);
 
-        auto tile = vram.tiles.tiles.get_tile_oam(tile_number);
+        auto sprites = current_line_sprites->get_sprites();
+
+        // Sprites with lower priority are drawn first, so that the ones with higher priority draw over them, but
+        // transparent pixels never draw over anything
+        for (auto current_sprite = sprites.rbegin(); current_sprite != sprites.rend(); ++current_sprite) {
+            int sprite_start_x = current_sprite->get_x() - sprite::x_offset;
+            int start_x = std::max(0, sprite_start_x);
+            int stop_x = std::min(screen_pixel_width, sprite_start_x + sprite::width);
+            if (start_x >= stop_x)
+                continue;
+
+            int sprite_y = registers.lcd_y - current_sprite->get_y() + sprite::y_offset;
+            if (current_sprite->get_y_flip())
+                sprite_y = sprite_height - sprite_y - 1;
+
+            auto tile_index = current_sprite->get_tile_number();
+            tile_index = sprite::get_correct_tile_index_for_size(tile_index, sprite_y, sprite_size);
+
+            // Flipped sprites use the flipped copy of the tile
+            const byte* tile_row = decoded_tiles.get_row(vram.tiles.tiles, tile_data::get_tile_number_oam(tile_index),
+                                                         sprite_y, current_sprite->get_x_flip());
+
+            byte flags = 0;
+            if (current_sprite->get_palette_number())
+                flags |= kernels::sprite_palette_flag;
+            if (current_sprite->get_priority())
+                flags |= kernels::sprite_priority_flag;
+
+            for (int x = start_x; x < stop_x; ++x) {
+                byte color = tile_row[x - sprite_start_x];
+                if (color != 0)
+                    sprite_line[x] = color | flags;
+            }
+        }
 
-        return tile.get_pixel(sprite_x, sprite_y);
+        is_sprite_line_drawn = true;
+        sprite_line_size = sprite_size;
     }
 
-    palette::pixel ppu::get_pixel_from_background_layer(int x) const {
-        int bg_x = (x + registers.scroll_x) & 0xFF;
-        int bg_y = (registers.lcd_y + registers.scroll_y) & 0xFF;
-
-        bool map_choice = registers.get_bg_tile_map_select();
-        const tile_data::map& tile_map = map_choice ? vram.tiles.tile_map_1 : vram.tiles.tile_map_0;
-
-        int tile_number_x = bg_x / tile::size;
-        int tile_number_y = bg_y / tile::size;
-
-        auto tile_index = tile_map.get_tile_index(tile_number_x, tile_number_y);
-
-        bool method = registers.get_bg_and_window_tile_data_select();
-        auto tile = vram.tiles.tiles.get_tile_bg_and_window(tile_index, method);
-
-        int tile_x = bg_x % tile::size;
-        int tile_y = bg_y % tile::size;
-
-        return tile.get_pixel(tile_x, tile_y);
+    void ppu::run_h_blank_t_cycle() {
+        // Nothing happens here
     }
 
-    palette::pixel ppu::get_pixel_from_window_layer(int x) const {
-        int window_x = x - (registers.window_x - 7);
-        int window_y = registers.lcd_y - registers.window_y;
-
-        bool map_choice = registers.get_window_tile_map_select();
-        const tile_data::map& tile_map = map_choice ? vram.tiles.tile_map_1 : vram.tiles.tile_map_0;
-
-        int tile_number_x = window_x / tile::size;
-        int tile_number_y = window_y / tile::size;
-
-        auto tile_index = tile_map.get_tile_index(tile_number_x, tile_number_y);
-
-        bool method = registers.get_bg_and_window_tile_data_select();
-        auto tile = vram.tiles.tiles.get_tile_bg_and_window(tile_index, method);
-
-        int tile_x = window_x % tile::size;
-        int tile_y = window_y % tile::size;
-
-        return tile.get_pixel(tile_x, tile_y);
-    }
+    void ppu::run_v_blank_t_cycle() {
+        // Render frame if first cycle
+        if (remaining_t_cycles == t_cycles_per_v_blank) {
+            renderer.render_frame();
+        }
 
-    bool ppu::check_if_in_window(int x) const {
-        return x >= registers.window_x - 7 && registers.lcd_y >= registers.window_y;
+        if (remaining_t_cycles % t_cycles_per_scanline == 0) {
+            increment_line_counter_and_check_for_match();
+        }
     }
 
-
     void ppu::move_to_next_mode() {
         mode next_mode = mode::oam_search;
         switch (current_mode) {
@@ -8,54 +8,37 @@
 
 #include <functional>
 #include <optional>
-#include <cstring>
+#include <algorithm>
 #include <utility>
-#include <SDL.h>
 
 #include "../cpu/cpu_interrupt_typedef.hpp"
+#include "../frontend/frame_sink.hpp"
+#include "../machine_state.hpp"
+#include "ppu_kernels.hpp"
+#include "sprite_line_index.hpp"
+#include "tile_cache.hpp"
 #include "ppu_data.hpp"
 
 namespace pixel_processing_unit {
-    constexpr int screen_pixel_width = 160;
-    constexpr int screen_pixel_height = 144;
-
+    // Collects the pixels of a frame, and hands the finished frame to the frontend
     class ppu_renderer {
-        SDL_Renderer *renderer;
-        SDL_Texture *texture;
-
-        palette::real_pixel_type screen_buffer[screen_pixel_height][screen_pixel_width]{};
+        frontend::frame_sink& frames;
 
-        void push_buffer_to_texture() {
-            palette::real_pixel_type *pixels;
-            int discard;
+        frontend::frame_buffer screen_buffer{};
 
-            SDL_LockTexture(texture, nullptr, (void**)(&pixels), &discard);
-            memcpy(pixels, screen_buffer, sizeof(screen_buffer));
-            SDL_UnlockTexture(texture);
-        }
     public:
-        explicit ppu_renderer(SDL_Renderer *renderer) : renderer(renderer) {
-            texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
-                                        screen_pixel_width, screen_pixel_height);
-        }
-
-        void save_pixel(int x, int y, palette::real_pixel_type color) {
-            screen_buffer[y][x] = color;
-        }
-
-        void render_frame() {
-            SDL_RenderClear(renderer);
+        explicit ppu_renderer(frontend::frame_sink& frames) : frames(frames) {}
 
-            push_buffer_to_texture();
-            SDL_RenderCopy(renderer, texture, nullptr, nullptr);
+        // Pixels are drawn straight into the line
+        [[nodiscard]] palette::real_pixel_type* get_line(int y) { return screen_buffer[y]; }
 
-            SDL_RenderPresent(renderer);
+        // The frame that is being drawn
+        template<typename visitor> void visit_state(visitor& visit) {
+            machine_state::visit_members(visit, screen_buffer);
         }
 
-        void render_blank_frame() {
-            SDL_RenderClear(renderer);
-            SDL_RenderPresent(renderer);
-        }
+        void render_frame() { frames.present_frame(screen_buffer); }
+        void render_blank_frame() { frames.present_blank_frame(); }
     };
 
     class ppu {
@@ -102,24 +85,39 @@ namespace pixel_processing_unit {
         vram_view vram{};
         oam_view oam{};
 
-        [[nodiscard]] bool is_vram_blocked() const { return current_mode == mode::pixel_transfer && is_powered_on; }
+        // Derived from the tile data, every write to it goes through write_vram
+        tile_cache decoded_tiles;
+        // Derived from OAM, updated by write_oam and write_oam_dma
+        sprite_line_index sprites_by_line;
+
+        // For every x, the pixel of the visible sprite in the format of kernels::compose_line, or 0 if none is visible.
+        // Drawn once per line before its first pixel, since VRAM and OAM can't change during pixel transfer, and only
+        // drawn again if the sprite size changes.
+        byte sprite_line[screen_pixel_width]{};
+        bool is_sprite_line_drawn{false};
+        sprite::size sprite_line_size{sprite::size8x8};
+
         [[nodiscard]] bool is_oam_blocked() const {
             return (current_mode == mode::pixel_transfer || current_mode == mode::oam_search) && is_powered_on;
         }
 
         void run_t_cycle();
+        // T-cycles that can run as one span, without a mode change or LY increment
+        [[nodiscard]] int get_span_t_cycles() const;
+        [[nodiscard]] int get_t_cycles_to_next_event() const;
 
         static void run_h_blank_t_cycle();
         void run_v_blank_t_cycle();
         void run_oam_search_t_cycle();
         void run_pixel_transfer_t_cycle();
+        // Draws the pixels of the current line from first_x up to end_x in one pass, with the registers as they are
+        // now. Background and window are walked a tile row at a time, then sprites are composited over them.
+        void draw_pixels(int first_x, int end_x);
 
-        // y is implicit;
-        palette::real_pixel_type get_pixel(int x);
-        [[nodiscard]] palette::pixel get_pixel_from_sprite(int x, sprite current_sprite, sprite::size current_size) const;
-        [[nodiscard]] palette::pixel get_pixel_from_background_layer(int x) const;
-        [[nodiscard]] palette::pixel get_pixel_from_window_layer(int x) const;
-        [[nodiscard]] bool check_if_in_window(int x) const;
+        // Internal colors of count pixels of a background or window row, starting at layer_x
+        void get_layer_pixels(const tile_data::map& tile_map, int layer_x, int layer_y, int count, byte* pixels);
+        // Draws the sprites of the current line into sprite_line, applying their priorities
+        void draw_sprite_line();
 
         void move_to_next_mode();
         void change_mode_to(mode new_mode);
@@ -140,11 +138,32 @@ namespace pixel_processing_unit {
         }
 
     public:
-        ppu(SDL_Renderer *renderer, interrupt_callback&& stat_callback, interrupt_callback&& v_blank_callback)
+        ppu(frontend::frame_sink& frames, interrupt_callback&& stat_callback, interrupt_callback&& v_blank_callback)
             : request_stat_interrupt(std::move(stat_callback)), request_v_blank_interrupt(std::move(v_blank_callback)),
-              renderer (renderer) {}
+              renderer(frames) {}
 
-        void run_machine_cycle();
+        template<typename visitor> void visit_state(visitor& visit) {
+            machine_state::visit_members(visit, is_powered_on, current_mode, remaining_t_cycles, current_line_sprites,
+                                         registers, vram, oam);
+            renderer.visit_state(visit);
+        }
+
+        // Machine cycles before the next mode change or LY increment. Until then the PPU can't change LY or STAT,
+        // or request interrupts, it only draws.
+        [[nodiscard]] int get_machine_cycles_to_next_event() const;
+        // Whole spans of a mode run at once, only the cycles that change the mode or LY run one by one
+        void run_machine_cycles(int count);
+
+        // Presents the screen buffer again, or a blank frame while the LCD is off
+        void present_current_frame() {
+            if (is_powered_on)
+                renderer.render_frame();
+            else
+                renderer.render_blank_frame();
+        }
+
+        // The memory map only maps VRAM directly while the CPU can access it
+        [[nodiscard]] bool is_vram_blocked() const { return current_mode == mode::pixel_transfer && is_powered_on; }
 
         byte read_vram(word address) {
             if (is_vram_blocked())
@@ -164,17 +183,35 @@ namespace pixel_processing_unit {
                 return;
 
             vram.raw_data[address] = value;
+            if (address < sizeof(tile_data))
+                decoded_tiles.mark_dirty(address / sizeof(tile));
         }
         void write_oam(word address, byte value) {
             if (is_oam_blocked())
                 return;
 
+            byte old_value = oam.raw_data[address];
             oam.raw_data[address] = value;
+            sprites_by_line.update_after_write(oam, address, old_value);
         }
 
-        // Basically a raw write
-        void write_oam_dma(word address, byte value) {
-            oam.raw_data[address] = value;
+        // DMA doesn't care about the mode, and copies all of OAM at once
+        void write_oam_dma(const byte* data) {
+            std::copy_n(data, sizeof(oam.raw_data), oam.raw_data);
+            sprites_by_line.invalidate();
+        }
+        // Tile data must not be written through these, the tile cache wouldn't know about it
+        [[nodiscard]] const byte* get_vram_data(word address) const { return vram.raw_data + address; }
+        [[nodiscard]] byte* get_vram_data(word address) { return vram.raw_data + address; }
+
+        // After VRAM or OAM was changed from outside, by loading a state
+        void invalidate_caches() {
+            decoded_tiles.mark_all_dirty();
+            sprites_by_line.invalidate();
+            is_sprite_line_drawn = false;
+        }
+        [[nodiscard]] const tile_cache::statistics& get_tile_cache_statistics() const {
+            return decoded_tiles.get_statistics();
         }
 
         [[nodiscard]] byte read_lcd_control() const { return registers.lcd_control; }
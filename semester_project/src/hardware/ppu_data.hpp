@@ -8,10 +8,15 @@
 
 #include <algorithm>
 #include <optional>
+#include <array>
+#include <span>
 
 #include "../utility.hpp"
 
 namespace pixel_processing_unit {
+    constexpr int screen_pixel_width = 160;
+    constexpr int screen_pixel_height = 144;
+
     // These struct act as a wrapper for raw VRAM/OAM data to make it easier to work with
     // A palette is basically a conversion table between 2-bit internal game boy colors and colors we draw to the
     // screen
@@ -30,6 +35,11 @@ namespace pixel_processing_unit {
         [[nodiscard]] real_pixel_type convert_to_real_pixel(pixel pixel) const {
             return master_palette[get_color_index(pixel)];
         }
+        // For converting a whole line with a table instead of one pixel at a time
+        [[nodiscard]] std::array<real_pixel_type, 4> get_real_pixels() const {
+            return {convert_to_real_pixel(0), convert_to_real_pixel(1), convert_to_real_pixel(2),
+                    convert_to_real_pixel(3)};
+        }
 
         // To be used by outside I/O
         void write_raw_value(byte value) { colors = value; }
@@ -62,19 +72,8 @@ namespace pixel_processing_unit {
         constexpr static int size = 8;
         constexpr static int bytes_per_row = 2;
 
-        [[nodiscard]] palette::pixel get_pixel(int x, int y) const {
-            x %= size;
-            y %= size;
-
-            byte low_bit_row = data[y * bytes_per_row];
-            byte high_bit_row = data[y * bytes_per_row + 1];
-
-            byte pixel = 0;
-            pixel |= utility::get_bit(low_bit_row, 7 - x);
-            pixel |= utility::get_bit(high_bit_row, 7 - x) << 1;
-
-            return {pixel};
-        }
+        // Decoded by kernels::decode_tile
+        [[nodiscard]] const byte* get_data() const { return data; }
 
     private:
         byte data[size * bytes_per_row];
@@ -95,29 +94,33 @@ namespace pixel_processing_unit {
             byte data[height][width];
         };
 
-        [[nodiscard]] tile get_tile_oam(byte index) const {
-            return get_tile_method_8000(index);
+        static constexpr int tile_count = 384;
+
+        // Tiles are numbered from 0 to tile_count - 1, in the order they are in VRAM
+        [[nodiscard]] const tile& get_tile(int number) const { return tiles[number]; }
+
+        [[nodiscard]] static int get_tile_number_oam(byte index) {
+            return get_tile_number_method_8000(index);
         }
 
-        [[nodiscard]] tile get_tile_bg_and_window(byte index, bool method) const {
-            return method ? get_tile_method_8000(index) : get_tile_method_8800(index);
+        [[nodiscard]] static int get_tile_number_bg_and_window(byte index, bool method) {
+            return method ? get_tile_number_method_8000(index) : get_tile_number_method_8800(index);
         }
 
     private:
-        static constexpr int tile_count = 384;
         static constexpr word method_8800_base_index = 256;
 
         tile tiles[tile_count];
 
-        [[nodiscard]] tile get_tile_method_8000(byte index) const {
-            return tiles[index];
+        [[nodiscard]] static int get_tile_number_method_8000(byte index) {
+            return index;
         }
 
-        [[nodiscard]] tile get_tile_method_8800(byte index) const {
+        [[nodiscard]] static int get_tile_number_method_8800(byte index) {
             word extended_offset = utility::sign_extend_byte_to_word(index);
             word result_index = method_8800_base_index + extended_offset;
 
-            return tiles[result_index];
+            return result_index;
         }
     };
 
@@ -172,87 +175,30 @@ namespace pixel_processing_unit {
 
     // Disposable object meant to be created every scanline
     class sprite_cache {
-        static constexpr int max_sprites = 10;
         int sprite_count = 0;
 
-        // Used to speed up the search for sprites at a given x coordinate
-        int last_found_sprite_index = 0;
-
-        // Used to skip checking sprites that are left of the current x coordinate, since we presume the x coordinate to
-        // be increasing
-        int start_index = 0;
-
-        sprite sprites[max_sprites]{};
-
         // Private so we can control the creation of this object
         sprite_cache() = default;
 
-        void sort_sprites () {
-            auto comparator = [](const sprite& a, const sprite& b) {
-                return a.get_x() < b.get_x();
-            };
-
-            // We need stable sort to preserve the order of sprites with the same x coordinate because they are
-            // prioritized by it
-            auto begin = std::begin(sprites);
-            auto end = begin + sprite_count;
-
-            std::stable_sort(begin, end, comparator);
-        }
-
-
     public:
         class factory;
 
-        std::optional<sprite> get_first_sprite_at_current_x(int x_coordinate) {
-            for (int i = start_index; i < sprite_count; ++i) {
-                int offset_x = x_coordinate + sprite::x_offset;
-
-                int sprite_start_x = sprites[i].get_x();
-                int sprite_end_x = sprite_start_x + sprite::width;
-
-                // If the x coordinate is lower than the sprite's start x, we can skip the rest of the sprites
-                if (offset_x < sprite_start_x) {
-                    break;
-                }
-
-                start_index = i;
-                // If the x coordinate is within the sprite's x range, we have found the first sprite
-                if (offset_x >= sprite_start_x && offset_x < sprite_end_x) {
-                    last_found_sprite_index = i;
-                    return sprites[i];
-                }
-            }
+        // The rest of the sprites on a line aren't drawn
+        static constexpr int max_sprites = 10;
 
-            return std::nullopt;
+        // Sorted by x, a sprite has priority over the ones after it
+        [[nodiscard]] std::span<const sprite> get_sprites() const {
+            return {sprites, static_cast<std::size_t>(sprite_count)};
         }
 
-        // Only meant to be run after get_first_sprite_at_current_x
-        std::optional<sprite> get_next_sprite_at_current_x(int x_coordinate) {
-            if (last_found_sprite_index == sprite_count - 1)
-                return std::nullopt;
-
-            // We offset the input X so that partially offscreen sprites are still drawn
-            int offset_x = x_coordinate + sprite::x_offset;
-
-            int sprite_start_x = sprites[last_found_sprite_index + 1].get_x();
-            int sprite_end_x = sprite_start_x + sprite::width;
-
-            if (offset_x >= sprite_start_x && offset_x < sprite_end_x) {
-                ++last_found_sprite_index;
-                return sprites[last_found_sprite_index];
-            }
-
-            return std::nullopt;
-        }
+    private:
+        sprite sprites[max_sprites]{};
     };
 
+    // Sprites have to be added in the order of their priority, see sprite_line_index
     class sprite_cache::factory {
         sprite_cache cache{};
 
-        void finalize() {
-            cache.sort_sprites();
-        }
     public:
         void add_sprite(sprite sprite) {
             if (cache.sprite_count == max_sprites)
@@ -262,7 +208,6 @@ namespace pixel_processing_unit {
         }
 
         sprite_cache create_cache() {
-            finalize();
             return cache;
         }
     };
@@ -351,31 +296,13 @@ namespace pixel_processing_unit {
     };
 
     union oam_view {
-    private:
         static constexpr int sprite_count = 40;
+    private:
         static constexpr int size = sprite_count * sizeof(sprite);
 
     public:
         sprite sprites[sprite_count]{};
         byte raw_data[size];
-
-        sprite_cache create_sprite_cache_for_line(int line_y_coordinate, sprite::size sprite_size) {
-            int sprite_height = sprite::get_height_from_size(sprite_size);
-            sprite_cache::factory cache_factory{};
-
-            int offset_y = line_y_coordinate + sprite::y_offset;
-
-            for (auto current_sprite : sprites) {
-                int sprite_start_y = current_sprite.get_y();
-                int sprite_end_y = sprite_start_y + sprite_height;
-
-                if (offset_y >= sprite_start_y && offset_y < sprite_end_y) {
-                    cache_factory.add_sprite(current_sprite);
-                }
-            }
-
-            return cache_factory.create_cache();
-        }
     };
 }
 #endif //SEMESTER_PROJECT_PPU_DATA_HPP
@@ -0,0 +1,276 @@
+// File: ppu_kernels.cpp
+//
+// Created by Adrian Habusta on 17.10.2026
+//
+
+#include "ppu_kernels.hpp"
+
+#if defined(PPU_KERNELS_SIMD)
+#include <immintrin.h>
+#endif
+
+namespace pixel_processing_unit::kernels {
+    namespace {
+        static_assert(sprite_palette_1_offset == sprite_palette_0_offset + sprite_palette_flag,
+                      "The palette flag has to select between the sprite palettes by itself");
+
+        constexpr int bytes_per_tile = tile::size * tile::bytes_per_row;
+        static_assert(bytes_per_tile == 16, "decode_tile reads a whole tile as one 16 byte vector");
+        constexpr byte sprite_color_mask = 0b11;
+
+        void decode_tile_scalar(const byte* data, byte* pixels) {
+            for (int y = 0; y < tile::size; ++y) {
+                byte low_bit_row = data[y * tile::bytes_per_row];
+                byte high_bit_row = data[y * tile::bytes_per_row + 1];
+
+                for (int x = 0; x < tile::size; ++x)
+                    *pixels++ = utility::get_bit(low_bit_row, 7 - x) | utility::get_bit(high_bit_row, 7 - x) << 1;
+            }
+        }
+
+        // Index into the color table
+        byte get_color_index(byte background, byte sprite) {
+            bool is_behind_background = (sprite & sprite_priority_flag) && background != 0;
+            if ((sprite & sprite_color_mask) == 0 || is_behind_background)
+                return background;
+
+            return sprite_palette_0_offset + (sprite & (sprite_color_mask | sprite_palette_flag));
+        }
+
+        void compose_line_scalar(const byte* background, const byte* sprites, int count, const color_table& colors,
+                                 palette::real_pixel_type* line) {
+            for (int x = 0; x < count; ++x)
+                line[x] = colors[get_color_index(background[x], sprites[x])];
+        }
+
+        constexpr kernel_set scalar_kernels{instruction_set::scalar, decode_tile_scalar, compose_line_scalar};
+
+#if defined(PPU_KERNELS_SIMD)
+        // Tile rows are decoded by broadcasting each bitplane byte to the 8 bytes of its row, and testing a different
+        // bit in each of them. PDEP could do a row in two instructions, but it is microcoded and slow on older AMD
+        // CPUs.
+
+        [[gnu::target("ssse3")]] __m128i get_internal_colors_ssse3(__m128i low_bits, __m128i high_bits) {
+            const __m128i bit_masks = _mm_setr_epi8(char(0x80), 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+                                                    char(0x80), 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+
+            __m128i low = _mm_cmpeq_epi8(_mm_and_si128(low_bits, bit_masks), bit_masks);
+            __m128i high = _mm_cmpeq_epi8(_mm_and_si128(high_bits, bit_masks), bit_masks);
+
+            return _mm_or_si128(_mm_and_si128(low, _mm_set1_epi8(1)), _mm_and_si128(high, _mm_set1_epi8(2)));
+        }
+
+        // Two rows at a time
+        [[gnu::target("ssse3")]] void decode_tile_ssse3(const byte* data, byte* pixels) {
+            __m128i tile_data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+
+            const __m128i low_rows = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 2, 2, 2, 2, 2, 2, 2, 2);
+            const __m128i high_rows = _mm_setr_epi8(1, 1, 1, 1, 1, 1, 1, 1, 3, 3, 3, 3, 3, 3, 3, 3);
+
+            for (int row_pair = 0; row_pair < tile::size / 2; ++row_pair) {
+                __m128i offset = _mm_set1_epi8(static_cast<char>(row_pair * 2 * tile::bytes_per_row));
+
+                __m128i low_bits = _mm_shuffle_epi8(tile_data, _mm_add_epi8(low_rows, offset));
+                __m128i high_bits = _mm_shuffle_epi8(tile_data, _mm_add_epi8(high_rows, offset));
+
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + row_pair * 2 * tile::size),
+                                 get_internal_colors_ssse3(low_bits, high_bits));
+            }
+        }
+
+        [[gnu::target("avx2")]] __m256i get_internal_colors_avx2(__m256i low_bits, __m256i high_bits) {
+            const __m256i bit_masks = _mm256_set1_epi64x(0x0102040810204080);
+
+            __m256i low = _mm256_cmpeq_epi8(_mm256_and_si256(low_bits, bit_masks), bit_masks);
+            __m256i high = _mm256_cmpeq_epi8(_mm256_and_si256(high_bits, bit_masks), bit_masks);
+
+            return _mm256_or_si256(_mm256_and_si256(low, _mm256_set1_epi8(1)),
+                                   _mm256_and_si256(high, _mm256_set1_epi8(2)));
+        }
+
+        // Four rows at a time, the shuffle only works within a 128-bit lane, so the tile is in both
+        [[gnu::target("avx2")]] void decode_tile_avx2(const byte* data, byte* pixels) {
+            __m256i tile_data = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data)));
+
+            const __m256i low_rows = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 2, 2, 2, 2, 2, 2, 2, 2,
+                                                      4, 4, 4, 4, 4, 4, 4, 4, 6, 6, 6, 6, 6, 6, 6, 6);
+            const __m256i high_rows = _mm256_add_epi8(low_rows, _mm256_set1_epi8(1));
+
+            for (int row_quad = 0; row_quad < tile::size / 4; ++row_quad) {
+                __m256i offset = _mm256_set1_epi8(static_cast<char>(row_quad * 4 * tile::bytes_per_row));
+
+                __m256i low_bits = _mm256_shuffle_epi8(tile_data, _mm256_add_epi8(low_rows, offset));
+                __m256i high_bits = _mm256_shuffle_epi8(tile_data, _mm256_add_epi8(high_rows, offset));
+
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(pixels + row_quad * 4 * tile::size),
+                                    get_internal_colors_avx2(low_bits, high_bits));
+            }
+        }
+
+        // Byte i of every color, so that a byte shuffle with the color indices looks up that byte of their colors
+        struct color_byte_tables {
+            alignas(16) byte tables[sizeof(palette::real_pixel_type)][std::tuple_size_v<color_table>];
+
+            explicit color_byte_tables(const color_table& colors) {
+                for (std::size_t i = 0; i < colors.size(); ++i) {
+                    for (std::size_t b = 0; b < sizeof(palette::real_pixel_type); ++b)
+                        tables[b][i] = static_cast<byte>(colors[i] >> (b * 8));
+                }
+            }
+        };
+
+        // The same as get_color_index, with masks instead of branches
+        [[gnu::target("ssse3")]] __m128i get_color_indices_ssse3(__m128i background, __m128i sprites) {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i priority_flag = _mm_set1_epi8(sprite_priority_flag);
+
+            __m128i no_sprite = _mm_cmpeq_epi8(_mm_and_si128(sprites, _mm_set1_epi8(sprite_color_mask)), zero);
+            __m128i is_behind = _mm_andnot_si128(_mm_cmpeq_epi8(background, zero),
+                                                 _mm_cmpeq_epi8(_mm_and_si128(sprites, priority_flag), priority_flag));
+            __m128i shows_background = _mm_or_si128(no_sprite, is_behind);
+
+            __m128i sprite_index = _mm_add_epi8(_mm_and_si128(sprites, _mm_set1_epi8(sprite_color_mask |
+                                                                                    sprite_palette_flag)),
+                                                _mm_set1_epi8(sprite_palette_0_offset));
+
+            return _mm_or_si128(_mm_and_si128(shows_background, background),
+                                _mm_andnot_si128(shows_background, sprite_index));
+        }
+
+        [[gnu::target("ssse3")]] void compose_line_ssse3(const byte* background, const byte* sprites, int count,
+                                                         const color_table& colors, palette::real_pixel_type* line) {
+            constexpr int pixels_per_step = 16;
+
+            color_byte_tables byte_tables(colors);
+            __m128i tables[4];
+            for (int b = 0; b < 4; ++b)
+                tables[b] = _mm_load_si128(reinterpret_cast<const __m128i*>(byte_tables.tables[b]));
+
+            int x = 0;
+            for (; x + pixels_per_step <= count; x += pixels_per_step) {
+                __m128i indices = get_color_indices_ssse3(
+                        _mm_loadu_si128(reinterpret_cast<const __m128i*>(background + x)),
+                        _mm_loadu_si128(reinterpret_cast<const __m128i*>(sprites + x)));
+
+                __m128i bytes[4];
+                for (int b = 0; b < 4; ++b)
+                    bytes[b] = _mm_shuffle_epi8(tables[b], indices);
+
+                // Interleave the bytes back into colors
+                __m128i low_01 = _mm_unpacklo_epi8(bytes[0], bytes[1]);
+                __m128i high_01 = _mm_unpackhi_epi8(bytes[0], bytes[1]);
+                __m128i low_23 = _mm_unpacklo_epi8(bytes[2], bytes[3]);
+                __m128i high_23 = _mm_unpackhi_epi8(bytes[2], bytes[3]);
+
+                auto* out = reinterpret_cast<__m128i*>(line + x);
+                _mm_storeu_si128(out, _mm_unpacklo_epi16(low_01, low_23));
+                _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(low_01, low_23));
+                _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(high_01, high_23));
+                _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(high_01, high_23));
+            }
+
+            compose_line_scalar(background + x, sprites + x, count - x, colors, line + x);
+        }
+
+        [[gnu::target("avx2")]] __m256i get_color_indices_avx2(__m256i background, __m256i sprites) {
+            const __m256i zero = _mm256_setzero_si256();
+            const __m256i priority_flag = _mm256_set1_epi8(sprite_priority_flag);
+
+            __m256i no_sprite = _mm256_cmpeq_epi8(_mm256_and_si256(sprites, _mm256_set1_epi8(sprite_color_mask)),
+                                                  zero);
+            __m256i is_behind = _mm256_andnot_si256(_mm256_cmpeq_epi8(background, zero),
+                                                    _mm256_cmpeq_epi8(_mm256_and_si256(sprites, priority_flag),
+                                                                      priority_flag));
+            __m256i shows_background = _mm256_or_si256(no_sprite, is_behind);
+
+            __m256i sprite_index = _mm256_add_epi8(_mm256_and_si256(sprites, _mm256_set1_epi8(sprite_color_mask |
+                                                                                             sprite_palette_flag)),
+                                                   _mm256_set1_epi8(sprite_palette_0_offset));
+
+            return _mm256_or_si256(_mm256_and_si256(shows_background, background),
+                                   _mm256_andnot_si256(shows_background, sprite_index));
+        }
+
+        [[gnu::target("avx2")]] void compose_line_avx2(const byte* background, const byte* sprites, int count,
+                                                       const color_table& colors, palette::real_pixel_type* line) {
+            constexpr int pixels_per_step = 32;
+
+            color_byte_tables byte_tables(colors);
+            __m256i tables[4];
+            for (int b = 0; b < 4; ++b)
+                tables[b] = _mm256_broadcastsi128_si256(
+                        _mm_load_si128(reinterpret_cast<const __m128i*>(byte_tables.tables[b])));
+
+            int x = 0;
+            for (; x + pixels_per_step <= count; x += pixels_per_step) {
+                __m256i indices = get_color_indices_avx2(
+                        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(background + x)),
+                        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sprites + x)));
+
+                __m256i bytes[4];
+                for (int b = 0; b < 4; ++b)
+                    bytes[b] = _mm256_shuffle_epi8(tables[b], indices);
+
+                // Unpacking works within lanes, each result has 4 colors from the first half and 4 from the second
+                __m256i low_01 = _mm256_unpacklo_epi8(bytes[0], bytes[1]);
+                __m256i high_01 = _mm256_unpackhi_epi8(bytes[0], bytes[1]);
+                __m256i low_23 = _mm256_unpacklo_epi8(bytes[2], bytes[3]);
+                __m256i high_23 = _mm256_unpackhi_epi8(bytes[2], bytes[3]);
+
+                __m256i colors_0 = _mm256_unpacklo_epi16(low_01, low_23);
+                __m256i colors_1 = _mm256_unpackhi_epi16(low_01, low_23);
+                __m256i colors_2 = _mm256_unpacklo_epi16(high_01, high_23);
+                __m256i colors_3 = _mm256_unpackhi_epi16(high_01, high_23);
+
+                auto* out = reinterpret_cast<__m256i*>(line + x);
+                _mm256_storeu_si256(out, _mm256_permute2x128_si256(colors_0, colors_1, 0x20));
+                _mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(colors_2, colors_3, 0x20));
+                _mm256_storeu_si256(out + 2, _mm256_permute2x128_si256(colors_0, colors_1, 0x31));
+                _mm256_storeu_si256(out + 3, _mm256_permute2x128_si256(colors_2, colors_3, 0x31));
+            }
+
+            compose_line_scalar(background + x, sprites + x, count - x, colors, line + x);
+        }
+
+        constexpr kernel_set ssse3_kernels{instruction_set::ssse3, decode_tile_ssse3, compose_line_ssse3};
+        constexpr kernel_set avx2_kernels{instruction_set::avx2, decode_tile_avx2, compose_line_avx2};
+#endif
+    }
+
+    std::string_view get_name(instruction_set set) {
+        switch (set) {
+            case instruction_set::ssse3: return "ssse3";
+            case instruction_set::avx2: return "avx2";
+            default: return "scalar";
+        }
+    }
+
+    std::vector<instruction_set> get_supported_instruction_sets() {
+        std::vector<instruction_set> sets{instruction_set::scalar};
+
+#if defined(PPU_KERNELS_SIMD)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("ssse3"))
+            sets.push_back(instruction_set::ssse3);
+        if (__builtin_cpu_supports("avx2"))
+            sets.push_back(instruction_set::avx2);
+#endif
+
+        return sets;
+    }
+
+    const kernel_set& get_kernels(instruction_set set) {
+        switch (set) {
+#if defined(PPU_KERNELS_SIMD)
+            case instruction_set::ssse3: return ssse3_kernels;
+            case instruction_set::avx2: return avx2_kernels;
+#endif
+            default: return scalar_kernels;
+        }
+    }
+
+    const kernel_set& get_best_kernels() {
+        static const kernel_set& best = get_kernels(get_supported_instruction_sets().back());
+        return best;
+    }
+}
@@ -0,0 +1,59 @@
+// File: ppu_kernels.hpp
+//
+// Created by Adrian Habusta on 17.10.2026
+//
+
+#ifndef SEMESTER_PROJECT_PPU_KERNELS_HPP
+#define SEMESTER_PROJECT_PPU_KERNELS_HPP
+
+#include <string_view>
+#include <vector>
+#include <array>
+
+#include "ppu_data.hpp"
+#include "../utility.hpp"
+
+// SIMD versions only exist for x86-64 with GCC or Clang, which can enable instruction sets for a single function
+#if defined(__x86_64__) && defined(__GNUC__)
+#define PPU_KERNELS_SIMD
+#endif
+
+namespace pixel_processing_unit::kernels {
+    enum class instruction_set {
+        scalar,
+        ssse3,
+        avx2
+    };
+
+    [[nodiscard]] std::string_view get_name(instruction_set set);
+    // From the slowest to the fastest, scalar is always supported
+    [[nodiscard]] std::vector<instruction_set> get_supported_instruction_sets();
+
+    // A pixel of the sprite line holds the internal color in the lowest two bits, and the flags below. It is 0 where
+    // no sprite is visible.
+    constexpr byte sprite_palette_flag = 1 << 2;
+    constexpr byte sprite_priority_flag = 1 << 3;
+
+    // The real colors of the background palette, then of sprite palette 0 and 1, the rest is unused
+    using color_table = std::array<palette::real_pixel_type, 16>;
+    constexpr int sprite_palette_0_offset = 4;
+    constexpr int sprite_palette_1_offset = 8;
+
+    // Every instruction set computes exactly the same results
+    struct kernel_set {
+        instruction_set set;
+
+        // The 16 bytes of a tile to its 64 internal colors, row by row, left to right
+        void (*decode_tile)(const byte* data, byte* pixels);
+        // Puts the sprite line over the background line, and converts the result to real colors
+        void (*compose_line)(const byte* background, const byte* sprites, int count, const color_table& colors,
+                             palette::real_pixel_type* line);
+    };
+
+    // Only for an instruction set returned by get_supported_instruction_sets
+    [[nodiscard]] const kernel_set& get_kernels(instruction_set set);
+    // The fastest set the CPU supports, chosen when it is first needed
+    [[nodiscard]] const kernel_set& get_best_kernels();
+}
+
+#endif //SEMESTER_PROJECT_PPU_KERNELS_HPP
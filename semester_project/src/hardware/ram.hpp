@@ -6,12 +6,17 @@
 #ifndef SEMESTER_PROJECT_RAM_HPP
 #define SEMESTER_PROJECT_RAM_HPP
 
+#include "../machine_state.hpp"
 #include "../utility.hpp"
 
 namespace random_access_memory {
     struct ram {
         byte read_wram(word address) { return wram[address]; }
         void write_wram(word address, byte value) { wram[address] = value;}
+        [[nodiscard]] const byte* get_wram_data(word address) const { return wram + address; }
+        [[nodiscard]] byte* get_wram_data(word address) { return wram + address; }
+
+        template<typename visitor> void visit_state(visitor& visit) { machine_state::visit_members(visit, wram, hram); }
 
         byte read_hram(word address) { return hram[address]; }
         void write_hram(word address, byte value) { hram[address] = value; }
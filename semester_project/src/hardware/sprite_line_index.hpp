@@ -0,0 +1,123 @@
+// File: sprite_line_index.hpp
+//
+// Created by Adrian Habusta on 17.10.2026
+//
+
+#ifndef SEMESTER_PROJECT_SPRITE_LINE_INDEX_HPP
+#define SEMESTER_PROJECT_SPRITE_LINE_INDEX_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <bit>
+
+#include "ppu_data.hpp"
+
+namespace pixel_processing_unit {
+    // Which sprites are on every line, kept up to date as OAM changes, so that OAM search doesn't have to look at all
+    // of them on every line. Every line has a bit for each sprite, and its selected sprites are sorted only when the
+    // line is needed after one of them changed.
+    class sprite_line_index {
+    public:
+        // Indices into OAM, in the order of their priority
+        struct line_sprites {
+            int count{};
+            byte indices[sprite_cache::max_sprites]{};
+        };
+
+        [[nodiscard]] const line_sprites& get_line(const oam_view& oam, int line, sprite::size size) {
+            static constexpr line_sprites no_sprites{};
+            if (line >= screen_pixel_height)
+                return no_sprites;
+
+            if (is_stale || size != indexed_size)
+                rebuild(oam, size);
+            if (!is_line_sorted[line])
+                select_line_sprites(oam, line);
+
+            return lines[line];
+        }
+
+        // Has to be called after every write to OAM, with the byte that was there before
+        void update_after_write(const oam_view& oam, int address, byte old_value) {
+            if (is_stale)
+                return;
+
+            int sprite_index = address / sizeof(sprite);
+            switch (address % sizeof(sprite)) {
+                // Y decides which lines the sprite is on
+                case 0:
+                    mark_lines(sprite_index, old_value, false);
+                    mark_lines(sprite_index, oam.sprites[sprite_index].get_y(), true);
+                    break;
+
+                // X decides its priority on all of them
+                case 1:
+                    for (int line = 0; line < screen_pixel_height; ++line) {
+                        if (utility::get_bit(line_masks[line], sprite_index))
+                            is_line_sorted[line] = false;
+                    }
+                    break;
+
+                // Tiles and attributes are read when the line is drawn
+                default: break;
+            }
+        }
+
+        // After all of OAM could have changed, it is indexed again when the next line is needed
+        void invalidate() { is_stale = true; }
+
+    private:
+        static_assert(oam_view::sprite_count <= 64, "Every sprite needs a bit in the line masks");
+
+        std::uint64_t line_masks[screen_pixel_height]{};
+        line_sprites lines[screen_pixel_height]{};
+        bool is_line_sorted[screen_pixel_height]{};
+
+        bool is_stale{true};
+        sprite::size indexed_size{sprite::size8x8};
+
+        void rebuild(const oam_view& oam, sprite::size size) {
+            std::fill(std::begin(line_masks), std::end(line_masks), 0);
+            indexed_size = size;
+
+            for (int i = 0; i < oam_view::sprite_count; ++i)
+                mark_lines(i, oam.sprites[i].get_y(), true);
+
+            std::fill(std::begin(is_line_sorted), std::end(is_line_sorted), false);
+            is_stale = false;
+        }
+
+        // The lines a sprite at y covers
+        void mark_lines(int sprite_index, int y, bool is_on_line) {
+            int first_line = std::max(y - sprite::y_offset, 0);
+            int end_line = std::min(y - sprite::y_offset + sprite::get_height_from_size(indexed_size),
+                                    screen_pixel_height);
+
+            std::uint64_t sprite_bit = std::uint64_t{1} << sprite_index;
+            for (int line = first_line; line < end_line; ++line) {
+                line_masks[line] = is_on_line ? line_masks[line] | sprite_bit : line_masks[line] & ~sprite_bit;
+                is_line_sorted[line] = false;
+            }
+        }
+
+        // Only the first sprites in OAM are drawn, the ones further left have priority, and then the ones first in OAM
+        void select_line_sprites(const oam_view& oam, int line) {
+            auto& selected = lines[line];
+            selected.count = 0;
+
+            auto mask = line_masks[line];
+            for (; mask != 0 && selected.count < sprite_cache::max_sprites; mask &= mask - 1)
+                selected.indices[selected.count++] = static_cast<byte>(std::countr_zero(mask));
+
+            std::sort(selected.indices, selected.indices + selected.count, [&](byte a, byte b) {
+                int a_x = oam.sprites[a].get_x();
+                int b_x = oam.sprites[b].get_x();
+                return a_x < b_x || (a_x == b_x && a < b);
+            });
+
+            is_line_sorted[line] = true;
+        }
+    };
+}
+
+#endif //SEMESTER_PROJECT_SPRITE_LINE_INDEX_HPP
@@ -0,0 +1,69 @@
+// File: tile_cache.hpp
+//
+// Created by Adrian Habusta on 17.10.2026
+//
+
+#ifndef SEMESTER_PROJECT_TILE_CACHE_HPP
+#define SEMESTER_PROJECT_TILE_CACHE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <array>
+
+#include "ppu_kernels.hpp"
+#include "ppu_data.hpp"
+
+namespace pixel_processing_unit {
+    // Every tile of VRAM decoded to one internal color per pixel, and the same flipped horizontally for sprites. Tile
+    // data rarely changes, so a tile is only decoded again the first time it is used after it was written to.
+    class tile_cache {
+    public:
+        struct statistics {
+            // Rows taken from an already decoded tile, and tiles decoded again
+            std::size_t hits{};
+            std::size_t misses{};
+        };
+
+        // The 8 internal colors of row y of the tile, left to right
+        [[nodiscard]] const byte* get_row(const tile_data& tiles, int tile_number, int y, bool x_flip) {
+            if (is_dirty[tile_number]) {
+                decode(tiles, tile_number);
+                ++stats.misses;
+            }
+            else {
+                ++stats.hits;
+            }
+
+            return decoded[x_flip][tile_number][y % tile::size];
+        }
+
+        void mark_dirty(int tile_number) { is_dirty[tile_number] = true; }
+        void mark_all_dirty() { is_dirty.fill(true); }
+
+        [[nodiscard]] const statistics& get_statistics() const { return stats; }
+
+    private:
+        byte decoded[2][tile_data::tile_count][tile::size][tile::size]{};
+        std::array<bool, tile_data::tile_count> is_dirty = [] {
+            std::array<bool, tile_data::tile_count> all{};
+            all.fill(true);
+            return all;
+        }();
+
+        statistics stats;
+
+        void decode(const tile_data& tiles, int tile_number) {
+            kernels::get_best_kernels().decode_tile(tiles.get_tile(tile_number).get_data(),
+                                                    &decoded[false][tile_number][0][0]);
+
+            for (int y = 0; y < tile::size; ++y) {
+                const byte* row = decoded[false][tile_number][y];
+                std::reverse_copy(row, row + tile::size, decoded[true][tile_number][y]);
+            }
+
+            is_dirty[tile_number] = false;
+        }
+    };
+}
+
+#endif //SEMESTER_PROJECT_TILE_CACHE_HPP
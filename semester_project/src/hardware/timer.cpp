@@ -6,29 +6,78 @@
 #include "timer.hpp"
 
 
-void timer::progress_divider() {
-    divider_counter += cycles_per_m_cycle;
+bool timer::get_counter_input(std::size_t machine_cycle) const {
+    return is_counter_enabled() && (get_internal_counter(machine_cycle) & (get_counter_speed() / 2)) != 0;
+}
+
+std::size_t timer::count_increments(std::size_t from, std::size_t to) const {
+    if (!is_counter_enabled())
+        return 0;
+
+    // The selected bit falls whenever the internal counter reaches a multiple of the speed
+    std::size_t speed = get_counter_speed();
+    return get_internal_counter(to) / speed - get_internal_counter(from) / speed;
+}
+
+void timer::increment_counter(std::size_t increments) {
+    while (increments > 0) {
+        std::size_t increments_to_overflow = 0x100 - counter;
+        if (increments < increments_to_overflow) {
+            counter += increments;
+            return;
+        }
 
-    if (divider_counter >= cycles_per_div_increment) {
-        divider_counter -= cycles_per_div_increment;
-        divider++;
+        increments -= increments_to_overflow;
+        counter = modulo;
+        request_cpu_interrupt();
     }
 }
 
-void timer::progress_main() {
+std::size_t timer::get_overflow_machine_cycle() const {
     if (!is_counter_enabled())
-        return;
+        return no_overflow;
 
-    main_counter += cycles_per_m_cycle;
+    std::size_t speed = get_counter_speed();
+    std::size_t increments_to_overflow = 0x100 - counter;
 
-    int counter_limit = get_counter_speed();
-    if (main_counter >= counter_limit) {
-        main_counter -= counter_limit;
-        counter++;
+    // Speeds are multiples of the 4 T-cycles per machine cycle, so this is always the end of a machine cycle
+    std::size_t overflow_value = (get_internal_counter(counter_cycle) / speed + increments_to_overflow) * speed;
+    return divider_reset_cycle + overflow_value / cycles_per_m_cycle;
+}
 
-        if (counter == 0) {
-            counter = modulo;
-            request_cpu_interrupt();
-        }
-    }
-}
\ No newline at end of file
+void timer::run_until(std::size_t machine_cycle) {
+    std::size_t increments = count_increments(counter_cycle, machine_cycle);
+    counter_cycle = machine_cycle;
+
+    increment_counter(increments);
+}
+
+byte timer::read_counter(std::size_t machine_cycle) const {
+    // run_until is called on every overflow, so the counter can't wrap in between
+    return counter + count_increments(counter_cycle, machine_cycle);
+}
+
+void timer::write_divider(std::size_t machine_cycle) {
+    run_until(machine_cycle);
+
+    // Clearing the internal counter is a falling edge if the selected bit was set
+    if (get_counter_input(machine_cycle))
+        increment_counter(1);
+
+    divider_reset_cycle = machine_cycle;
+}
+
+void timer::write_counter(byte value, std::size_t machine_cycle) {
+    run_until(machine_cycle);
+    counter = value;
+}
+
+void timer::write_control(byte value, std::size_t machine_cycle) {
+    run_until(machine_cycle);
+
+    // Disabling the counter, or selecting a bit that is clear, is a falling edge too
+    bool old_input = get_counter_input(machine_cycle);
+    control = value;
+    if (old_input && !get_counter_input(machine_cycle))
+        increment_counter(1);
+}
@@ -7,53 +7,70 @@
 #define SEMESTER_PROJECT_TIMER_HPP
 
 #include <utility>
-
-#include <utility>
+#include <limits>
+#include <cstddef>
 
 #include "../cpu/cpu_interrupt_typedef.hpp"
+#include "../machine_state.hpp"
 #include "../utility.hpp"
-//TODO
-class timer {
-    static constexpr int system_frequency = 4194304; //4MhZ
-    static constexpr int divider_frequency = 16384;
-    static constexpr int cycles_per_div_increment = system_frequency / divider_frequency;
 
+// Doesn't run on its own. DIV is the upper byte of an internal counter that increases by 4 every machine cycle, so
+// both are computed from the machine cycle in which the counter was last reset. TIMA increments on every falling edge
+// of one bit of the internal counter, and is only brought up to date when it is accessed, or when it overflows.
+class timer {
     static constexpr int cycles_per_m_cycle = 4;
 
+    // T-cycles per increment, the counter increments on the falling edge of bit speed / 2
     static constexpr int speeds [4] = {1024, 16, 64, 256};
 
-    int divider_counter = 0;
-    int main_counter = 0;
+    std::size_t divider_reset_cycle = 0;
 
-    byte divider = 0;
+    // Value of TIMA in counter_cycle
     byte counter = 0;
+    std::size_t counter_cycle = 0;
+
     byte modulo = 0;
     byte control = 0;
 
     [[nodiscard]] bool is_counter_enabled() const { return utility::get_bit(control, 2); };
     [[nodiscard]] int get_counter_speed() const { return speeds[control & 0b11]; };
 
-    void progress_divider();
-    void progress_main();
+    [[nodiscard]] std::size_t get_internal_counter(std::size_t machine_cycle) const {
+        return (machine_cycle - divider_reset_cycle) * cycles_per_m_cycle;
+    }
+    // The signal whose falling edges increment the counter
+    [[nodiscard]] bool get_counter_input(std::size_t machine_cycle) const;
+    // Falling edges after from, up to and including to
+    [[nodiscard]] std::size_t count_increments(std::size_t from, std::size_t to) const;
+    void increment_counter(std::size_t increments);
 
     interrupt_callback request_cpu_interrupt;
 public:
+    static constexpr std::size_t no_overflow = std::numeric_limits<std::size_t>::max();
+
     explicit timer(interrupt_callback&& callback) : request_cpu_interrupt(std::move(callback)) {};
-    void run_machine_cycle() {
-        progress_divider();
-        progress_main();
+
+    template<typename visitor> void visit_state(visitor& visit) {
+        machine_state::visit_members(visit, divider_reset_cycle, counter, counter_cycle, modulo, control);
     }
 
-    [[nodiscard]] byte read_divider() const { return divider; };
-    [[nodiscard]] byte read_counter() const { return counter; };
+    // Machine cycle at the end of which the counter overflows, no_overflow if it is disabled
+    [[nodiscard]] std::size_t get_overflow_machine_cycle() const;
+    // Must be called in that cycle at the latest, the interrupt is requested when the counter overflows in here
+    void run_until(std::size_t machine_cycle);
+
+    [[nodiscard]] byte read_divider(std::size_t machine_cycle) const {
+        return get_internal_counter(machine_cycle) >> 8;
+    };
+    [[nodiscard]] byte read_counter(std::size_t machine_cycle) const;
     [[nodiscard]] byte read_modulo() const { return modulo; };
     [[nodiscard]] byte read_control() const { return control; };
 
-    // value is unused here, writing to div resets it
-    void write_divider(byte value [[maybe_unused]]) { divider = 0; };
-    void write_counter(byte value) { counter = value; };
+    // Any write resets the internal counter
+    void write_divider(std::size_t machine_cycle);
+    void write_counter(byte value, std::size_t machine_cycle);
     void write_modulo(byte value) { modulo = value; };
-    void write_control(byte value) { control = value; };
+    void write_control(byte value, std::size_t machine_cycle);
 };
 
 #endif //SEMESTER_PROJECT_TIMER_HPP
@@ -0,0 +1,265 @@
+// File: rewind_buffer.cpp
+//
+// Created by Adrian Habusta on 17.10.2026
+//
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <span>
+
+#include "rewind_buffer.hpp"
+
+namespace history {
+    namespace {
+        // Equal runs shorter than this are cheaper to store as part of the XORed run around them
+        constexpr std::size_t min_equal_run = 4;
+
+        // LEB128
+        std::size_t write_length(std::size_t length, byte* out) {
+            std::size_t written = 0;
+            do {
+                byte low_bits = length & 0x7F;
+                length >>= 7;
+                out[written++] = length > 0 ? low_bits | 0x80 : low_bits;
+            } while (length > 0);
+
+            return written;
+        }
+
+        std::size_t read_length(const byte*& in) {
+            std::size_t length = 0;
+            for (int shift = 0;; shift += 7) {
+                byte value = *in++;
+                length |= static_cast<std::size_t>(value & 0x7F) << shift;
+                if ((value & 0x80) == 0)
+                    return length;
+            }
+        }
+
+        struct delta_encoder {
+            std::span<const byte> state;
+            std::span<const byte> reference;
+            // Pages where the state can't differ from the reference are 0
+            std::span<const byte> dirty_pages;
+
+            [[nodiscard]] std::size_t find_difference(std::size_t from) const {
+                std::size_t i = from;
+                while (i < state.size()) {
+                    std::size_t page = i / emulator::emulator::state_page_size;
+                    std::size_t page_end = std::min((page + 1) * emulator::emulator::state_page_size, state.size());
+
+                    if (dirty_pages[page] == 0) {
+                        i = page_end;
+                        continue;
+                    }
+
+                    for (; i + sizeof(std::uint64_t) <= page_end; i += sizeof(std::uint64_t)) {
+                        std::uint64_t state_word, reference_word;
+                        std::memcpy(&state_word, state.data() + i, sizeof(state_word));
+                        std::memcpy(&reference_word, reference.data() + i, sizeof(reference_word));
+                        if (state_word != reference_word)
+                            break;
+                    }
+                    for (; i < page_end; ++i) {
+                        if (state[i] != reference[i])
+                            return i;
+                    }
+                }
+
+                return state.size();
+            }
+
+            // The end of the run of differences starting at from, including short equal runs inside it
+            [[nodiscard]] std::size_t find_difference_end(std::size_t from) const {
+                std::size_t i = from;
+                while (i < state.size()) {
+                    if (state[i] != reference[i]) {
+                        ++i;
+                        continue;
+                    }
+
+                    std::size_t equal_end = i;
+                    while (equal_end < state.size() && equal_end - i < min_equal_run &&
+                           state[equal_end] == reference[equal_end])
+                        ++equal_end;
+
+                    if (equal_end - i >= min_equal_run || equal_end == state.size())
+                        return i;
+                    i = equal_end;
+                }
+
+                return state.size();
+            }
+
+            // Pairs of the length of an equal run, and of an XORed run followed by its bytes
+            std::size_t encode(byte* out) const {
+                std::size_t written = 0;
+                std::size_t position = 0;
+
+                while (position < state.size()) {
+                    std::size_t difference_start = find_difference(position);
+                    std::size_t difference_end = find_difference_end(difference_start);
+
+                    written += write_length(difference_start - position, out + written);
+                    written += write_length(difference_end - difference_start, out + written);
+                    for (std::size_t i = difference_start; i < difference_end; ++i)
+                        out[written++] = state[i] ^ reference[i];
+
+                    position = difference_end;
+                }
+
+                return written;
+            }
+        };
+
+        void decode(const byte* encoded, std::span<const byte> reference, std::span<byte> state) {
+            std::size_t position = 0;
+            while (position < state.size()) {
+                std::size_t equal_length = read_length(encoded);
+                std::copy_n(reference.data() + position, equal_length, state.data() + position);
+                position += equal_length;
+
+                std::size_t difference_length = read_length(encoded);
+                for (std::size_t i = 0; i < difference_length; ++i, ++position)
+                    state[position] = *encoded++ ^ reference[position];
+            }
+        }
+    }
+
+    rewind_buffer::rewind_buffer(emulator::emulator& emulator, const config& settings)
+        : emu(emulator), settings(settings), storage(settings.memory_budget), state_size(emulator.get_state_size()),
+          current_state(state_size), encoded_state(2 * state_size + 64), empty_state(state_size),
+          keyframe(state_size) {
+        if (encoded_state.size() > storage.size()) {
+            throw std::runtime_error("Rewind needs a memory budget of at least " +
+                                     std::to_string(encoded_state.size()) + " bytes");
+        }
+
+        std::size_t page_count = (state_size + emulator::emulator::state_page_size - 1) /
+                                 emulator::emulator::state_page_size;
+        dirty_pages.assign(page_count, 1);
+        all_pages_dirty.assign(page_count, 1);
+    }
+
+    void rewind_buffer::record_frame() {
+        if (++frames_since_snapshot < settings.frames_between_snapshots)
+            return;
+
+        frames_since_snapshot = 0;
+        take_snapshot();
+    }
+
+    void rewind_buffer::take_snapshot() {
+        emu.save_state(current_state);
+        emu.collect_dirty_state_pages(dirty_pages);
+
+        bool is_keyframe = !has_keyframe || snapshots_since_keyframe + 1 >= settings.snapshots_per_keyframe;
+
+        std::size_t size;
+        std::size_t offset;
+        while (true) {
+            if (is_keyframe)
+                size = delta_encoder{current_state, empty_state, all_pages_dirty}.encode(encoded_state.data());
+            else
+                size = delta_encoder{current_state, keyframe, dirty_pages}.encode(encoded_state.data());
+
+            offset = make_space(size);
+
+            // Making space dropped the keyframe this snapshot was encoded against
+            if (is_keyframe || !snapshots.empty())
+                break;
+            is_keyframe = true;
+        }
+
+        std::copy_n(encoded_state.data(), size, storage.data() + offset);
+
+        if (is_keyframe) {
+            std::copy(current_state.begin(), current_state.end(), keyframe.begin());
+            decoded_keyframe_number = ++keyframe_count;
+            has_keyframe = true;
+            snapshots_since_keyframe = 0;
+            std::fill(dirty_pages.begin(), dirty_pages.end(), 0);
+        }
+        else {
+            ++snapshots_since_keyframe;
+        }
+
+        snapshots.push_back({offset, size, emu.get_frame_count(), decoded_keyframe_number, is_keyframe});
+    }
+
+    std::size_t rewind_buffer::make_space(std::size_t size) {
+        std::size_t start = snapshots.empty() ? 0 : snapshots.back().offset + snapshots.back().size;
+
+        // Snapshots are never split, the end of the storage is left unused instead
+        bool wraps = start + size > storage.size();
+        std::size_t tail_start = start;
+        if (wraps)
+            start = 0;
+
+        auto overlaps = [&](const snapshot& oldest) {
+            return (wraps && oldest.offset >= tail_start) ||
+                   (oldest.offset < start + size && start < oldest.offset + oldest.size);
+        };
+        while (!snapshots.empty() && overlaps(snapshots.front()))
+            drop_oldest_snapshot();
+
+        return start;
+    }
+
+    void rewind_buffer::drop_oldest_snapshot() {
+        snapshots.pop_front();
+
+        // Without their keyframe, the snapshots after it can't be decoded
+        while (!snapshots.empty() && !snapshots.front().is_keyframe)
+            snapshots.pop_front();
+    }
+
+    void rewind_buffer::decode_keyframe(std::size_t keyframe_number) {
+        if (decoded_keyframe_number == keyframe_number)
+            return;
+
+        auto found = std::find_if(snapshots.begin(), snapshots.end(), [&](const snapshot& candidate) {
+            return candidate.is_keyframe && candidate.keyframe_number == keyframe_number;
+        });
+        decode(storage.data() + found->offset, empty_state, keyframe);
+        decoded_keyframe_number = keyframe_number;
+    }
+
+    bool rewind_buffer::step_back() {
+        while (!snapshots.empty() && snapshots.back().frame >= emu.get_frame_count())
+            snapshots.pop_back();
+        if (snapshots.empty()) {
+            has_keyframe = false;
+            return false;
+        }
+
+        const snapshot& newest = snapshots.back();
+        decode_keyframe(newest.keyframe_number);
+        if (newest.is_keyframe)
+            std::copy(keyframe.begin(), keyframe.end(), current_state.begin());
+        else
+            decode(storage.data() + newest.offset, keyframe, current_state);
+
+        emu.load_state(current_state);
+
+        // The next snapshot is encoded against the keyframe of this one, and compares every page
+        snapshots_since_keyframe = 0;
+        for (auto it = snapshots.rbegin(); !it->is_keyframe; ++it)
+            ++snapshots_since_keyframe;
+        std::fill(dirty_pages.begin(), dirty_pages.end(), 1);
+        frames_since_snapshot = 0;
+
+        return true;
+    }
+
+    std::size_t rewind_buffer::get_used_memory() const {
+        std::size_t used = 0;
+        for (const auto& stored : snapshots)
+            used += stored.size;
+
+        return used;
+    }
+}
@@ -0,0 +1,83 @@
+// File: rewind_buffer.hpp
+//
+// Created by Adrian Habusta on 17.10.2026
+//
+
+#ifndef SEMESTER_PROJECT_REWIND_BUFFER_HPP
+#define SEMESTER_PROJECT_REWIND_BUFFER_HPP
+
+#include <cstddef>
+#include <vector>
+#include <deque>
+
+#include "../emulator.hpp"
+#include "../utility.hpp"
+
+namespace history {
+    struct config {
+        // Only the snapshots count towards it, the buffers for encoding them are a few more save states
+        std::size_t memory_budget = 16 << 20;
+        std::size_t frames_between_snapshots = 2;
+        // Every this many snapshots, one is stored on its own, the rest only as the difference to it
+        std::size_t snapshots_per_keyframe = 60;
+    };
+
+    // Keeps save states of the last frames in a ring buffer of a fixed size, the oldest ones are dropped once it is
+    // full. Snapshots are encoded as runs of bytes that are the same as in the last keyframe, and runs of bytes XORed
+    // with it. Pages of the state that the emulator didn't write since the keyframe aren't compared at all.
+    class rewind_buffer {
+        struct snapshot {
+            std::size_t offset;
+            std::size_t size;
+            std::size_t frame;
+            // Counts keyframes since the start, a snapshot that isn't a keyframe is encoded against this one
+            std::size_t keyframe_number;
+            bool is_keyframe;
+        };
+
+        emulator::emulator& emu;
+        config settings;
+
+        std::vector<byte> storage;
+        std::deque<snapshot> snapshots;
+
+        std::size_t state_size;
+        std::vector<byte> current_state;
+        std::vector<byte> encoded_state;
+        // Keyframes are encoded against an empty state
+        std::vector<byte> empty_state;
+        std::vector<byte> keyframe;
+        std::size_t decoded_keyframe_number{};
+        bool has_keyframe{false};
+
+        // Of the state, since the last keyframe
+        std::vector<byte> dirty_pages;
+        std::vector<byte> all_pages_dirty;
+
+        std::size_t frames_since_snapshot{};
+        std::size_t snapshots_since_keyframe{};
+        std::size_t keyframe_count{};
+
+        void take_snapshot();
+        // Returns where the encoded state has to be copied to, after dropping the snapshots that were there
+        std::size_t make_space(std::size_t size);
+        void drop_oldest_snapshot();
+        void decode_keyframe(std::size_t keyframe_number);
+
+    public:
+        // Throws if not even a keyframe fits into the budget
+        rewind_buffer(emulator::emulator& emulator, const config& settings);
+
+        // Has to be called after every frame
+        void record_frame();
+
+        // Loads the newest snapshot that is older than the current frame, returns false if there is none
+        bool step_back();
+
+        [[nodiscard]] std::size_t get_snapshot_count() const { return snapshots.size(); }
+        // Bytes of the budget used by snapshots
+        [[nodiscard]] std::size_t get_used_memory() const;
+    };
+}
+
+#endif //SEMESTER_PROJECT_REWIND_BUFFER_HPP
@@ -0,0 +1,49 @@
+// File: run_ahead.cpp
+//
+// Created by Adrian Habusta on 17.10.2026
+//
+
+#include "run_ahead.hpp"
+
+namespace history {
+    run_ahead::run_ahead(emulator::emulator& emulator, frame_gate& frames, input_gate& input,
+                         std::size_t frames_ahead)
+        : emu(emulator), frames(frames), input(input), frames_ahead(frames_ahead),
+          saved_state(frames_ahead > 0 ? emulator.get_state_size() : 0) {}
+
+    emulator::run_result run_ahead::run_frame() {
+        if (frames_ahead == 0)
+            return emu.run_frame();
+
+        // The real frame waits for the frame time as usual, the hidden ones run as fast as possible
+        frames.set_open(false);
+        auto result = emu.run_frame();
+        if (result != emulator::run_result::frame_complete) {
+            frames.set_open(true);
+            return result;
+        }
+
+        emu.save_state(saved_state);
+        bool was_frame_rate_limited = emu.is_frame_rate_limited();
+        emu.set_frame_rate_limited(false);
+        input.set_open(false);
+
+        std::size_t passed_frames = frames.get_passed_frame_count();
+        for (std::size_t i = 0; i < frames_ahead; ++i) {
+            frames.set_open(i + 1 == frames_ahead);
+            if (emu.run_frame() != emulator::run_result::frame_complete)
+                break;
+        }
+
+        // The PPU doesn't present anything while the LCD stays off, and the CPU could stop before the last frame
+        frames.set_open(true);
+        if (frames.get_passed_frame_count() == passed_frames)
+            emu.present_current_frame();
+
+        input.set_open(true);
+        emu.set_frame_rate_limited(was_frame_rate_limited);
+        emu.load_state(saved_state);
+
+        return result;
+    }
+}
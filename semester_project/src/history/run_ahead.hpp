@@ -0,0 +1,79 @@
+// File: run_ahead.hpp
+//
+// Created by Adrian Habusta on 17.10.2026
+//
+
+#ifndef SEMESTER_PROJECT_RUN_AHEAD_HPP
+#define SEMESTER_PROJECT_RUN_AHEAD_HPP
+
+#include <cstddef>
+#include <vector>
+
+#include "../frontend/frame_sink.hpp"
+#include "../frontend/input_source.hpp"
+#include "../emulator.hpp"
+#include "../utility.hpp"
+
+namespace history {
+    // Only passes frames on while it is open
+    class frame_gate : public frontend::frame_sink {
+        frontend::frame_sink& sink;
+        bool is_open{true};
+        std::size_t passed_frames{};
+
+    public:
+        explicit frame_gate(frontend::frame_sink& sink) : sink(sink) {}
+
+        void set_open(bool open) { is_open = open; }
+        [[nodiscard]] std::size_t get_passed_frame_count() const { return passed_frames; }
+
+        void present_frame(const frontend::frame_buffer& frame) override {
+            if (!is_open)
+                return;
+            sink.present_frame(frame);
+            ++passed_frames;
+        }
+        void present_blank_frame() override {
+            if (!is_open)
+                return;
+            sink.present_blank_frame();
+            ++passed_frames;
+        }
+    };
+
+    // While closed, the emulator sees no events and the buttons stay as they are, the events wait in the source
+    class input_gate : public frontend::input_source {
+        frontend::input_source& source;
+        bool is_open{true};
+
+    public:
+        explicit input_gate(frontend::input_source& source) : source(source) {}
+
+        void set_open(bool open) { is_open = open; }
+
+        std::optional<frontend::input_event> poll_event() override {
+            return is_open ? source.poll_event() : std::nullopt;
+        }
+        [[nodiscard]] bool is_rewind_held() override { return source.is_rewind_held(); }
+    };
+
+    // Hides the lag between a button press and the frame that shows it. Every frame runs normally, but without being
+    // shown, and then the emulator runs further with the same buttons, only the last of those frames is shown, and
+    // the state is loaded back. The emulator has to be created with the gates.
+    class run_ahead {
+        emulator::emulator& emu;
+        frame_gate& frames;
+        input_gate& input;
+
+        std::size_t frames_ahead;
+        std::vector<byte> saved_state;
+
+    public:
+        run_ahead(emulator::emulator& emulator, frame_gate& frames, input_gate& input, std::size_t frames_ahead);
+
+        // Same as emulator::run_frame, with 0 frames ahead it is only that
+        emulator::run_result run_frame();
+    };
+}
+
+#endif //SEMESTER_PROJECT_RUN_AHEAD_HPP
@@ -0,0 +1,122 @@
+// File: jit_check.cpp
+//
+// Created by Adrian Habusta on 17.10.2026
+//
+
+// Runs a ROM on two emulators side by side, one with the JIT and one with the interpreter, and compares the CPU state
+// after every step. With --bench, it instead measures how fast each of them runs on its own.
+
+#include <string_view>
+#include <iostream>
+#include <optional>
+#include <chrono>
+#include <string>
+
+#include "emulator.hpp"
+
+constexpr std::size_t default_frame_count = 3600;
+
+void run_until_frame(emulator::emulator& emu, std::size_t frame_count) {
+    while (emu.get_frame_count() < frame_count) {
+        if (emu.run_frame() == emulator::run_result::quit_requested)
+            return;
+    }
+}
+
+int run_differential(std::string_view boot_rom_path, std::string_view rom_path, std::size_t frame_count) {
+    // Nothing is shown, and without input both emulators see exactly the same joypad
+    frontend::null_frame_sink frames;
+    frontend::null_input_source input;
+    emulator::emulator jit(frames, input, boot_rom_path, rom_path, "");
+    emulator::emulator interpreter(frames, input, boot_rom_path, rom_path, "");
+
+    for (auto* emu : {&jit, &interpreter})
+        emu->set_frame_rate_limited(false);
+    interpreter.set_jit_enabled(false);
+
+    std::size_t steps = 0;
+    while (jit.get_frame_count() < frame_count) {
+        jit.step_cpu();
+        interpreter.step_cpu();
+        ++steps;
+
+        bool same_cycles = jit.get_total_machine_cycles() == interpreter.get_total_machine_cycles();
+        if (!same_cycles || !jit.get_cpu().has_same_state(interpreter.get_cpu())) {
+            std::cout << "Mismatch after " << steps << " steps" << std::endl;
+            std::cout << "JIT:         " << jit.get_cpu().describe_state()
+                      << " cycles=" << jit.get_total_machine_cycles() << std::endl;
+            std::cout << "Interpreter: " << interpreter.get_cpu().describe_state()
+                      << " cycles=" << interpreter.get_total_machine_cycles() << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "No mismatches in " << steps << " steps (" << frame_count << " frames)" << std::endl;
+    return 0;
+}
+
+void run_benchmark(std::string_view boot_rom_path, std::string_view rom_path, std::size_t frame_count,
+                   bool jit_enabled) {
+    frontend::null_frame_sink frames;
+    frontend::null_input_source input;
+    emulator::emulator emu(frames, input, boot_rom_path, rom_path, "");
+    emu.set_frame_rate_limited(false);
+    emu.set_jit_enabled(jit_enabled);
+
+    auto start = std::chrono::steady_clock::now();
+    run_until_frame(emu, frame_count);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    double seconds = elapsed.count();
+    double megahertz = emu.get_total_machine_cycles() / seconds / 1e6;
+    double fast_forwarded = 100.0 * emu.get_fast_forwarded_machine_cycles() / emu.get_total_machine_cycles();
+
+    std::cout << (jit_enabled ? "JIT:         " : "Interpreter: ") << frame_count << " frames in " << seconds
+              << " s, " << frame_count / seconds << " fps, " << megahertz << " MHz (M-cycles), "
+              << fast_forwarded << " % fast-forwarded";
+
+    const auto& idle_loops = emu.get_cpu().get_idle_loops();
+    std::cout << ", " << idle_loops.idle_loops << " of " << idle_loops.analyzed_loops << " loops idle, "
+              << idle_loops.fast_forwards << " idle loop skips (" << idle_loops.fast_forwarded_machine_cycles
+              << " M-cycles)";
+
+    if (const auto* compiler = emu.get_cpu().get_jit()) {
+        std::cout << ", " << compiler->compiled_blocks << " blocks compiled, " << compiler->rejected_blocks
+                  << " rejected, " << compiler->compiled_executions << " compiled block runs";
+    }
+    std::cout << std::endl;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cout << "Usage: jit_check boot_rom rom [frames] [--bench]" << std::endl;
+        return 1;
+    }
+
+    std::string_view boot_rom_path = argv[1];
+    std::string_view rom_path = argv[2];
+    std::size_t frame_count = default_frame_count;
+    bool benchmark = false;
+
+    for (int i = 3; i < argc; ++i) {
+        std::string_view argument = argv[i];
+        if (argument == "--bench")
+            benchmark = true;
+        else
+            frame_count = std::stoul(std::string(argument));
+    }
+
+    try {
+        if (!benchmark)
+            return run_differential(boot_rom_path, rom_path, frame_count);
+
+        run_benchmark(boot_rom_path, rom_path, frame_count, false);
+        run_benchmark(boot_rom_path, rom_path, frame_count, true);
+    }
+    catch (const std::runtime_error& e) {
+        std::cout << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,129 @@
+// File: kernel_bench.cpp
+//
+// Created by Adrian Habusta on 17.10.2026
+//
+
+// Compares the PPU kernels of every instruction set the CPU supports. Each one first has to give the same results as
+// the scalar kernels on random tiles and lines, then decoding tiles and composing lines is timed.
+
+#include <iostream>
+#include <iomanip>
+#include <cstdint>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "hardware/ppu_kernels.hpp"
+
+namespace kernels = pixel_processing_unit::kernels;
+using pixel_processing_unit::palette;
+
+constexpr std::size_t default_iterations = 200000;
+constexpr int tile_bytes = 16;
+constexpr int tile_pixels = 64;
+constexpr int line_width = pixel_processing_unit::screen_pixel_width;
+// Enough different inputs that the branches of the scalar kernels can't be learned
+constexpr std::size_t input_count = 256;
+
+struct inputs {
+    std::vector<byte> tiles;
+    std::vector<byte> backgrounds;
+    std::vector<byte> sprites;
+    kernels::color_table colors{};
+};
+
+inputs create_inputs() {
+    // Distributions aren't the same on every standard library, so only the raw generator is used
+    std::minstd_rand generator(1);
+    inputs result;
+
+    for (std::size_t i = 0; i < input_count * tile_bytes; ++i)
+        result.tiles.push_back(static_cast<byte>(generator()));
+
+    for (std::size_t i = 0; i < input_count * line_width; ++i) {
+        result.backgrounds.push_back(static_cast<byte>(generator() % 4));
+
+        // About half of the line is covered by sprites, with every combination of flags
+        byte sprite = 0;
+        if (generator() % 2 == 0)
+            sprite = static_cast<byte>(generator() % 4 | (generator() % 4) << 2);
+        result.sprites.push_back(sprite);
+    }
+
+    for (auto& color : result.colors)
+        color = static_cast<palette::real_pixel_type>(generator()) << 1 ^ generator();
+
+    return result;
+}
+
+bool matches_scalar(const kernels::kernel_set& tested, const inputs& input) {
+    const auto& scalar = kernels::get_kernels(kernels::instruction_set::scalar);
+
+    for (std::size_t i = 0; i < input_count; ++i) {
+        byte expected_tile[tile_pixels], tile[tile_pixels];
+        scalar.decode_tile(&input.tiles[i * tile_bytes], expected_tile);
+        tested.decode_tile(&input.tiles[i * tile_bytes], tile);
+        if (!std::equal(tile, tile + tile_pixels, expected_tile))
+            return false;
+
+        // Every length, so that the scalar tail of the SIMD kernels is checked too
+        int count = static_cast<int>(i % (line_width + 1));
+        palette::real_pixel_type expected_line[line_width]{}, line[line_width]{};
+        scalar.compose_line(&input.backgrounds[i * line_width], &input.sprites[i * line_width], count, input.colors,
+                            expected_line);
+        tested.compose_line(&input.backgrounds[i * line_width], &input.sprites[i * line_width], count, input.colors,
+                            line);
+        if (!std::equal(line, line + line_width, expected_line))
+            return false;
+    }
+
+    return true;
+}
+
+// Nanoseconds per call
+template<typename function> double time_calls(std::size_t iterations, function&& call) {
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < iterations; ++i)
+        call(i % input_count);
+    std::chrono::duration<double, std::nano> time = std::chrono::steady_clock::now() - start;
+
+    return time.count() / static_cast<double>(iterations);
+}
+
+int main(int argc, char** argv) {
+    std::size_t iterations = argc > 1 ? std::stoul(argv[1]) : default_iterations;
+    auto input = create_inputs();
+
+    std::cout << "kernels  decode_tile  compose_line (" << line_width << " pixels)" << std::endl;
+
+    // Keeps the results alive, so the calls can't be optimized out
+    std::uint64_t checksum = 0;
+    for (auto set : kernels::get_supported_instruction_sets()) {
+        const auto& tested = kernels::get_kernels(set);
+        if (!matches_scalar(tested, input)) {
+            std::cout << kernels::get_name(set) << " gives different results than scalar!" << std::endl;
+            return 1;
+        }
+
+        byte tile[tile_pixels];
+        double decode_time = time_calls(iterations, [&](std::size_t i) {
+            tested.decode_tile(&input.tiles[i * tile_bytes], tile);
+            checksum += tile[i % tile_pixels];
+        });
+
+        palette::real_pixel_type line[line_width];
+        double compose_time = time_calls(iterations, [&](std::size_t i) {
+            tested.compose_line(&input.backgrounds[i * line_width], &input.sprites[i * line_width], line_width,
+                                input.colors, line);
+            checksum += line[i % line_width];
+        });
+
+        std::cout << std::left << std::setw(9) << kernels::get_name(set) << std::right << std::fixed
+                  << std::setprecision(1) << std::setw(9) << decode_time << " ns" << std::setw(11) << compose_time
+                  << " ns" << std::endl;
+    }
+
+    std::cout << "Every kernel matches scalar. (checksum " << checksum % 1000 << ")" << std::endl;
+    return 0;
+}
@@ -0,0 +1,33 @@
+// File: machine_state.hpp
+//
+// Created by Adrian Habusta on 17.10.2026
+//
+
+#ifndef SEMESTER_PROJECT_MACHINE_STATE_HPP
+#define SEMESTER_PROJECT_MACHINE_STATE_HPP
+
+#include <type_traits>
+#include <functional>
+#include <span>
+
+#include "utility.hpp"
+
+// Every component lists the members that make up its state in a visit_state method, which passes each of them to a
+// visitor as bytes. Caches, statistics and anything else that can't change what the emulator does are left out.
+namespace machine_state {
+    // Used where a template visitor can't be passed, like virtual methods
+    using byte_visitor = std::function<void(std::span<byte>)>;
+
+    template<typename member_type>
+    std::span<byte> as_bytes(member_type& member) {
+        static_assert(std::is_trivially_copyable_v<member_type>, "State has to be copyable byte by byte");
+        return {reinterpret_cast<byte*>(&member), sizeof(member_type)};
+    }
+
+    template<typename visitor, typename... member_types>
+    void visit_members(visitor& visit, member_types&... members) {
+        (visit(as_bytes(members)), ...);
+    }
+}
+
+#endif //SEMESTER_PROJECT_MACHINE_STATE_HPP
@@ -1,30 +1,153 @@
-
 #include <string_view>
 #include <iostream>
-#include <thread>
+#include <optional>
+#include <string>
+#include <vector>
+
+#if defined(FRONTEND_SDL)
 #include <SDL.h>
+#include "frontend/sdl_frontend.hpp"
+#endif
 
+#include "history/rewind_buffer.hpp"
+#include "history/run_ahead.hpp"
 #include "emulator.hpp"
 
 constexpr int screen_size_factor = 4;
 
-void free_sdl(SDL_Renderer* renderer, SDL_Window* window) {
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
-    SDL_Quit();
+struct options {
+    // Never initializes SDL video, and runs as fast as possible
+    bool headless = false;
+    std::optional<std::size_t> frame_limit;
+    // Rewinding is off with 0
+    std::size_t rewind_budget_mib = 16;
+    std::size_t run_ahead_frames = 0;
+
+    std::vector<std::string_view> paths;
+};
+
+// Returns nothing if the argument isn't a number
+std::optional<std::size_t> parse_number(const char* argument) {
+    try {
+        return std::stoul(argument);
+    }
+    catch (const std::exception&) {
+        return std::nullopt;
+    }
 }
 
-int main(int argc, char** argv) {
-    if(argc < 3) {
+// Returns nothing if the arguments are wrong
+std::optional<options> parse_arguments(int argc, char** argv) {
+    options result;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string_view argument = argv[i];
+
+        if (argument == "--headless") {
+            result.headless = true;
+        }
+        else if (argument == "--frames") {
+            auto value = ++i < argc ? parse_number(argv[i]) : std::nullopt;
+            if (!value) {
+                std::cout << "Expected a frame count after --frames." << std::endl;
+                return std::nullopt;
+            }
+            result.frame_limit = *value;
+        }
+        else if (argument == "--rewind") {
+            auto value = ++i < argc ? parse_number(argv[i]) : std::nullopt;
+            if (!value) {
+                std::cout << "Expected a memory budget in MiB after --rewind." << std::endl;
+                return std::nullopt;
+            }
+            result.rewind_budget_mib = *value;
+        }
+        else if (argument == "--run-ahead") {
+            auto value = ++i < argc ? parse_number(argv[i]) : std::nullopt;
+            if (!value) {
+                std::cout << "Expected a frame count after --run-ahead." << std::endl;
+                return std::nullopt;
+            }
+            result.run_ahead_frames = *value;
+        }
+        else {
+            result.paths.push_back(argument);
+        }
+    }
+
+    if (result.paths.size() < 2) {
         std::cout << "Not enough arguments! Expected 2 or 3." << std::endl;
-        return 1;
+        return std::nullopt;
     }
 
-    if(argc > 4) {
+    if (result.paths.size() > 3) {
         std::cout << "Too many arguments! Expected 2 or 3." << std::endl;
+        return std::nullopt;
+    }
+
+    return result;
+}
+
+int run(frontend::frame_sink& frames, frontend::input_source& input, const options& emulator_options) {
+    std::string_view boot_rom_path = emulator_options.paths[0];
+    std::string_view rom_path = emulator_options.paths[1];
+    std::string_view sram_path = emulator_options.paths.size() == 3 ? emulator_options.paths[2] : "";
+
+    // Run-ahead hides frames and input from the emulator through these
+    history::frame_gate gated_frames(frames);
+    history::input_gate gated_input(input);
+
+    std::optional<emulator::emulator> emu{std::nullopt};
+    std::optional<history::run_ahead> ahead{std::nullopt};
+    std::optional<history::rewind_buffer> rewinder{std::nullopt};
+    try {
+        emu.emplace(gated_frames, gated_input, boot_rom_path, rom_path, sram_path);
+        ahead.emplace(*emu, gated_frames, gated_input, emulator_options.run_ahead_frames);
+
+        // Nothing can hold the rewind key without a window
+        if (emulator_options.rewind_budget_mib > 0 && !emulator_options.headless) {
+            history::config rewind_settings;
+            rewind_settings.memory_budget = emulator_options.rewind_budget_mib << 20;
+            rewinder.emplace(*emu, rewind_settings);
+        }
+    }
+    catch (const std::runtime_error& e) {
+        std::cout << e.what() << std::endl;
         return 1;
     }
 
+    emu->set_frame_rate_limited(!emulator_options.headless);
+
+    while (!emulator_options.frame_limit || emu->get_frame_count() < *emulator_options.frame_limit) {
+        if (rewinder && input.is_rewind_held()) {
+            // Stays on the oldest frame once there is nothing left
+            rewinder->step_back();
+            emu->present_current_frame();
+            continue;
+        }
+
+        auto result = ahead->run_frame();
+        if (rewinder)
+            rewinder->record_frame();
+
+        if (result == emulator::run_result::quit_requested)
+            break;
+        // Without input, nothing can wake the CPU up
+        if (result == emulator::run_result::stop && emulator_options.headless)
+            break;
+    }
+
+    return 0;
+}
+
+#if defined(FRONTEND_SDL)
+void free_sdl(SDL_Renderer* renderer, SDL_Window* window) {
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+}
+
+int run_in_window(const options& emulator_options) {
     int window_height = pixel_processing_unit::screen_pixel_height * screen_size_factor;
     int window_width = pixel_processing_unit::screen_pixel_width * screen_size_factor;
 
@@ -38,30 +161,36 @@ int main(int argc, char** argv) {
                                               SDL_WINDOW_OPENGL);
     SDL_Renderer* renderer = SDL_CreateRenderer(main_window, -1, SDL_RENDERER_ACCELERATED);
 
-    std::string_view boot_rom_path = argv[1];
-    std::string_view rom_path = argv[2];
-    std::string_view sram_path = argc == 4 ? argv[3] : "";
+    SDL_RenderClear(renderer);
+    SDL_RenderPresent(renderer);
 
-    std::optional<emulator::emulator> emu{std::nullopt};
-    try {
-        emu.emplace(renderer, boot_rom_path, rom_path, sram_path);
-    }
-    catch (const std::runtime_error& e) {
-        std::cout << e.what() << std::endl;
-        free_sdl(renderer, main_window);
-        return 1;
+    int result;
+    {
+        frontend::sdl_frame_sink frames(renderer);
+        frontend::sdl_input_source input;
+        result = run(frames, input, emulator_options);
     }
 
-    SDL_RenderClear(renderer);
-    SDL_RenderPresent(renderer);
+    free_sdl(renderer, main_window);
+    return result;
+}
+#endif
 
-    while(true) {
-        try {
-            emu->execute_cpu();
-        }
-        catch (const emulator::exit&) {
-            free_sdl(renderer, main_window);
-            return 0;
-        }
+int main(int argc, char** argv) {
+    auto emulator_options = parse_arguments(argc, argv);
+    if (!emulator_options)
+        return 1;
+
+    if (emulator_options->headless) {
+        frontend::null_frame_sink frames;
+        frontend::null_input_source input;
+        return run(frames, input, *emulator_options);
     }
-}
\ No newline at end of file
+
+#if defined(FRONTEND_SDL)
+    return run_in_window(*emulator_options);
+#else
+    std::cout << "Built without SDL, only --headless is available." << std::endl;
+    return 1;
+#endif
+}
@@ -10,6 +10,7 @@
 #include <functional>
 #include <fstream>
 #include <cstdint>
+#include <limits>
 
 using byte = uint8_t;
 using word = uint16_t;
@@ -17,6 +18,8 @@ using dword = uint32_t;
 
 namespace utility {
     constexpr byte undefined_byte = 0xFF;
+    // Used by components that never limit how many idle cycles can be skipped
+    constexpr int no_limit = std::numeric_limits<int>::max();
 
     template<typename T>
     inline constexpr T set_bit(T value, int bit) {